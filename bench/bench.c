@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "cgba/backend.h"
+#include "cgba/gba.h"
+
+/* a minute of the game's time */
+#define DEFAULT_BENCH_FRAMES 3600
+
+struct input_args {
+    char *biosfile;
+    char *commit;
+    char **romfiles;
+    int num_romfiles;
+    int frames;
+};
+
+/* What one ROM's run measured, passed back from the process it ran in */
+typedef struct bench_result {
+    uint64_t frames;
+    uint64_t instructions;
+    uint64_t clocks;
+    double seconds;
+    long peak_rss_kb;
+} bench_result;
+
+/* A headless backend that quits after a fixed number of frames */
+typedef struct bench_backend {
+    gba_backend backend;
+    int frames_left;
+} bench_backend;
+
+static void bench_present_frame(gba_backend *backend,
+                                const uint32_t *frame_buffer,
+                                const bool *line_changed)
+{
+    (void)backend;
+    (void)frame_buffer;
+    (void)line_changed;
+}
+
+static bool bench_poll_input(gba_backend *backend, uint16_t *buttons_held, uint16_t *hotkeys_held)
+{
+    bench_backend *bench = (bench_backend *)backend;
+    *buttons_held = 0;
+    *hotkeys_held = 0;
+    return --bench->frames_left > 0;
+}
+
+static void bench_destroy(gba_backend *backend)
+{
+    (void)backend;
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr,
+            "Usage: %s [-n frames] [-b biosfile] [-c commit] <romfile>...\n"
+            "Options:\n"
+            "-b    Specify a BIOS file to load into the emulator\n"
+            "-c    Name the commit being measured in the results\n"
+            "-n    Emulate this many frames of each game (default %d)\n",
+            progname,
+            DEFAULT_BENCH_FRAMES);
+}
+
+static int parse_args(int argc, char **argv, struct input_args *args)
+{
+    args->biosfile = NULL;
+    args->commit = NULL;
+    args->frames = DEFAULT_BENCH_FRAMES;
+    opterr = false;
+
+    int opt;
+    char *end;
+    while ((opt = getopt(argc, argv, "b:c:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b':
+                args->biosfile = optarg;
+                break;
+
+            case 'c':
+                args->commit = optarg;
+                break;
+
+            case 'n':
+                args->frames = strtol(optarg, &end, 10);
+                if (*end != '\0' || end == optarg || args->frames < 1)
+                {
+                    fprintf(stderr, "Invalid number of frames: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case '?':
+                if (optopt == 'b' || optopt == 'c' || optopt == 'n')
+                    fprintf(stderr, "Option '%c' specified but no value was given\n", optopt);
+                else
+                    fprintf(stderr, "Unknown option '%c'\n", optopt);
+                return -1;
+        }
+    }
+
+    if (optind == argc)
+    {
+        fputs("No ROMs to benchmark\n", stderr);
+        return -1;
+    }
+
+    args->romfiles = argv + optind;
+    args->num_romfiles = argc - optind;
+    return 0;
+}
+
+static double monotonic_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Run a game headless and as fast as possible, in a process of its own
+ * so that its peak memory use is its own. Output from the emulator goes
+ * to stderr, leaving stdout to the results.
+ */
+static void run_bench(const struct input_args *args, const char *romfile, int result_fd)
+{
+    bench_backend backend = {
+        .backend = {
+            .present_frame = bench_present_frame,
+            .poll_input = bench_poll_input,
+            .destroy = bench_destroy,
+        },
+        .frames_left = args->frames,
+    };
+
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) == -1)
+        exit(1);
+
+    gba_system gba;
+    init_system_or_die(&gba, romfile, args->biosfile, &backend.backend);
+    init_frame_pacer(&gba.pacer, 0, false);
+    gba.speed = 0;
+
+    double start = monotonic_seconds();
+    run_system(&gba);
+    double end = monotonic_seconds();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    bench_result result = {
+        .frames = args->frames,
+        .instructions = gba.instructions_emulated,
+        .clocks = gba.clocks_emulated,
+        .seconds = end - start,
+        .peak_rss_kb = usage.ru_maxrss,
+    };
+
+    deinit_system(&gba);
+
+    if (write(result_fd, &result, sizeof result) != sizeof result)
+        exit(1);
+
+    exit(0);
+}
+
+/* Returns 0, or -1 if the game failed to load or crashed */
+static int measure_rom(const struct input_args *args, const char *romfile, bench_result *result)
+{
+    int fds[2];
+    if (pipe(fds))
+    {
+        perror("Error creating pipe");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("Error starting benchmark");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        run_bench(args, romfile, fds[1]);
+    }
+
+    close(fds[1]);
+    ssize_t bytes_read = read(fds[0], result, sizeof *result);
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    if (bytes_read != sizeof *result || !WIFEXITED(status) || WEXITSTATUS(status))
+    {
+        fprintf(stderr, "Benchmark of %s failed\n", romfile);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static void print_result(const char *romfile, const bench_result *result)
+{
+    fputs("    {\"rom\": ", stdout);
+    print_json_string(romfile);
+    printf(", \"frames\": %llu, \"instructions\": %llu, \"cycles\": %llu, "
+           "\"seconds\": %.6f, \"fps\": %.2f, \"mips\": %.3f, "
+           "\"ns_per_instruction\": %.3f, \"peak_rss_kb\": %ld}",
+           (unsigned long long)result->frames,
+           (unsigned long long)result->instructions,
+           (unsigned long long)result->clocks,
+           result->seconds,
+           result->frames / result->seconds,
+           result->instructions / result->seconds / 1e6,
+           result->seconds * 1e9 / result->instructions,
+           result->peak_rss_kb);
+}
+
+int main(int argc, char **argv)
+{
+    struct input_args args;
+    if (parse_args(argc, argv, &args))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("{\n  \"commit\": ");
+    if (args.commit != NULL)
+        print_json_string(args.commit);
+    else
+        fputs("null", stdout);
+    printf(",\n  \"frames\": %d,\n  \"results\": [", args.frames);
+
+    int failures = 0;
+    bool first = true;
+    for (int i = 0; i < args.num_romfiles; ++i)
+    {
+        bench_result result;
+        if (measure_rom(&args, args.romfiles[i], &result))
+        {
+            ++failures;
+            continue;
+        }
+
+        fputs(first ? "\n" : ",\n", stdout);
+        print_result(args.romfiles[i], &result);
+        first = false;
+    }
+
+    puts("\n  ]\n}");
+    return failures ? 1 : 0;
+}
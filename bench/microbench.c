@@ -0,0 +1,425 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "arm7tdmi.h"
+#include "cgba/backend.h"
+#include "cgba/gba.h"
+#include "cgba/memory.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC
+#endif
+
+/* Calls timed for each benchmark, after as many again to warm up */
+#define DEFAULT_MICROBENCH_OPS (1 << 22)
+
+/* Instructions in each synthetic stream, the last being a branch back
+ * to the start. Long enough that the branch is a small part of what's
+ * timed, short enough for a THUMB branch to reach back.
+ */
+#define STREAM_LENGTH 512
+
+/* Inputs cycled through by the shifter and memory benchmarks. Varying
+ * them keeps the branch predictor from learning a single path.
+ */
+#define NUM_INPUTS 4096
+
+#define ROM_START 0x08000000
+#define IWRAM_DATA 0x03000100
+
+struct input_args {
+    char *commit;
+    long ops;
+};
+
+typedef struct timing {
+    uint64_t ns;
+    uint64_t ticks; // time stamp counter, 0 where there isn't one
+} timing;
+
+typedef struct decode_bench {
+    const char *name;
+    bool thumb;
+    uint32_t opcodes[4]; // cycled through; 0 ends the list early
+} decode_bench;
+
+static const decode_bench decode_benches[] = {
+    {"arm/add_imm",         false, {0xe2800001}},             // add r0, r0, #1
+    {"arm/add_shift_imm",   false, {0xe0811182}},             // add r1, r1, r2, lsl #3
+    {"arm/mov_shift_reg",   false, {0xe1a03574}},             // mov r3, r4, ror r5
+    {"arm/mul",             false, {0xe0060897}},             // mul r6, r7, r8
+    {"arm/ldr",             false, {0xe5990000}},             // ldr r0, [r9]
+    {"arm/str",             false, {0xe5890000}},             // str r0, [r9]
+    {"arm/cond_fail",       false, {0x02800001}},             // addeq r0, r0, #1
+    {"arm/mixed",           false, {0xe2800001, 0xe5990000, 0xe1a03574, 0x02800001}},
+    {"thumb/add_imm",       true,  {0x3001}},                 // adds r0, #1
+    {"thumb/lsl_imm",       true,  {0x00d3}},                 // lsls r3, r2, #3
+    {"thumb/ldr",           true,  {0x6808}},                 // ldr r0, [r1]
+    {"thumb/str",           true,  {0x6008}},                 // str r0, [r1]
+    {"thumb/mixed",         true,  {0x3001, 0x6808, 0x00d3, 0x6008}},
+};
+
+typedef struct shift_bench {
+    const char *name;
+    bool immediate;
+    bool shift_by_reg;
+    int shift_opcode;
+} shift_bench;
+
+static const shift_bench shift_benches[] = {
+    {"shift/rotate_imm", true,  false, 0},
+    {"shift/lsl",        false, false, 0},
+    {"shift/lsr",        false, false, 1},
+    {"shift/asr",        false, false, 2},
+    {"shift/ror",        false, false, 3},
+    {"shift/lsl_reg",    false, true,  0},
+    {"shift/ror_reg",    false, true,  3},
+};
+
+/* Where each region's accesses go, cycling a word at a time through
+ * size bytes from base. I/O stays within the background scroll
+ * registers, where writes have no side effects.
+ */
+typedef struct region_bench {
+    const char *name;
+    uint32_t base;
+    uint32_t size;
+    bool writable;
+} region_bench;
+
+static const region_bench region_benches[] = {
+    {"bios",    0x00000000, 0x4000,  false},
+    {"ewram",   0x02000000, 0x40000, true},
+    {"iwram",   0x03000000, 0x8000,  true},
+    {"io",      0x04000010, 0x10,    true},
+    {"palette", 0x05000000, 0x400,   true},
+    {"vram",    0x06000000, 0x18000, true},
+    {"oam",     0x07000000, 0x400,   true},
+    {"rom",     0x08000000, 0x10000, false},
+    {"sram",    0x0e000000, 0x10000, true},
+};
+
+// results go here so the work behind them isn't optimized away
+static volatile uint32_t sink;
+
+static bool first_result = true;
+
+static void microbench_present_frame(gba_backend *backend,
+                                     const uint32_t *frame_buffer,
+                                     const bool *line_changed)
+{
+    (void)backend;
+    (void)frame_buffer;
+    (void)line_changed;
+}
+
+static bool microbench_poll_input(gba_backend *backend, uint16_t *buttons_held, uint16_t *hotkeys_held)
+{
+    (void)backend;
+    *buttons_held = 0;
+    *hotkeys_held = 0;
+    return true;
+}
+
+static void microbench_destroy(gba_backend *backend)
+{
+    (void)backend;
+}
+
+static gba_backend microbench_backend = {
+    .present_frame = microbench_present_frame,
+    .poll_input = microbench_poll_input,
+    .destroy = microbench_destroy,
+};
+
+static void usage(const char *progname)
+{
+    fprintf(stderr,
+            "Usage: %s [-n ops] [-c commit]\n"
+            "Options:\n"
+            "-c    Name the commit being measured in the results\n"
+            "-n    Time this many operations of each kind (default %d)\n",
+            progname,
+            DEFAULT_MICROBENCH_OPS);
+}
+
+static int parse_args(int argc, char **argv, struct input_args *args)
+{
+    args->commit = NULL;
+    args->ops = DEFAULT_MICROBENCH_OPS;
+    opterr = false;
+
+    int opt;
+    char *end;
+    while ((opt = getopt(argc, argv, "c:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                args->commit = optarg;
+                break;
+
+            case 'n':
+                args->ops = strtol(optarg, &end, 10);
+                if (*end != '\0' || end == optarg || args->ops < 1)
+                {
+                    fprintf(stderr, "Invalid number of operations: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case '?':
+                if (optopt == 'c' || optopt == 'n')
+                    fprintf(stderr, "Option '%c' specified but no value was given\n", optopt);
+                else
+                    fprintf(stderr, "Unknown option '%c'\n", optopt);
+                return -1;
+        }
+    }
+
+    return optind == argc ? 0 : -1;
+}
+
+/* The TSC counts at a fixed rate rather than the core's clock, so
+ * ticks are only cycles while the core runs at its base frequency
+ */
+static timing now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    timing t = {.ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec};
+#ifdef HAS_TSC
+    t.ticks = __rdtsc();
+#endif
+    return t;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static void print_result(const char *name, long ops, timing start, timing end)
+{
+    fputs(first_result ? "\n    {\"name\": " : ",\n    {\"name\": ", stdout);
+    print_json_string(name);
+    printf(", \"ops\": %ld, \"ns_per_op\": %.3f, \"ticks_per_op\": ",
+           ops,
+           (double)(end.ns - start.ns) / ops);
+#ifdef HAS_TSC
+    printf("%.3f}", (double)(end.ticks - start.ticks) / ops);
+#else
+    fputs("null}", stdout);
+#endif
+
+    first_result = false;
+}
+
+/* Fill the ROM with a stream of opcodes, ending in a branch back to the
+ * start. Returns the ROM's size.
+ */
+static size_t build_stream(const decode_bench *bench, uint8_t *rom)
+{
+    int num_opcodes = 0;
+    while (num_opcodes < 4 && bench->opcodes[num_opcodes])
+        ++num_opcodes;
+
+    int inst_size = bench->thumb ? 2 : 4;
+    for (int i = 0; i < STREAM_LENGTH; ++i)
+    {
+        uint32_t opcode = bench->opcodes[i % num_opcodes];
+        if (i == STREAM_LENGTH - 1)
+        {
+            // b start, from where the pipeline has PC two instructions on
+            int32_t offset = -(i + 2) * inst_size;
+            if (bench->thumb)
+                opcode = 0xe000 | ((offset >> 1) & 0x7ff);
+            else
+                opcode = 0xea000000 | ((offset >> 2) & 0xffffff);
+        }
+
+        memcpy(rom + i * inst_size, &opcode, inst_size);
+    }
+
+    return (size_t)STREAM_LENGTH * inst_size;
+}
+
+static void run_decode_bench(gba_system *gba, const decode_bench *bench, long ops)
+{
+    static uint8_t rom[STREAM_LENGTH * 4];
+    size_t size = build_stream(bench, rom);
+    if (load_rom_buffer(gba->mem, rom, size))
+        exit(1);
+
+    arm7tdmi *cpu = gba->cpu;
+    reset_system(gba);
+
+    // operands that keep each instruction on its common path
+    for (int i = R0; i <= R12; ++i)
+        cpu->registers[i] = 0x01234567 * (i + 1);
+    cpu->registers[R5] = 7;
+    cpu->registers[R9] = IWRAM_DATA;
+    cpu->registers[R1] = IWRAM_DATA;
+    cpu->cpsr &= ~COND_FLAGS_MASK;
+    if (bench->thumb)
+    {
+        cpu->cpsr |= T_BITMASK;
+        cpu->registers[R15] = ROM_START;
+        reload_pipeline(cpu);
+    }
+
+    int (*decode_and_execute)(arm7tdmi *) = bench->thumb
+                                          ? decode_and_execute_thumb
+                                          : decode_and_execute_arm;
+
+    // a run through first, to warm caches and predictors
+    uint32_t clocks = 0;
+    for (long i = 0; i < ops; ++i)
+        clocks += decode_and_execute(cpu);
+
+    timing start = now();
+    for (long i = 0; i < ops; ++i)
+        clocks += decode_and_execute(cpu);
+    timing end = now();
+
+    sink = clocks;
+    print_result(bench->name, ops, start, end);
+}
+
+static void run_shift_bench(gba_system *gba, const shift_bench *bench, long ops)
+{
+    static barrel_shift_args args[NUM_INPUTS];
+
+    uint32_t x = 0x9e3779b9;
+    for (int i = 0; i < NUM_INPUTS; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        args[i] = (barrel_shift_args){
+            .shift_input = x,
+            // rotated immediates only rotate by even amounts
+            .shift_amt = bench->immediate ? (x >> 24) & 0x1e
+                       : bench->shift_by_reg ? (x >> 24) & 0x3f
+                       : (x >> 24) & 0x1f,
+            .immediate = bench->immediate,
+            .shift_by_reg = bench->shift_by_reg,
+            .shift_opcode = bench->shift_opcode,
+        };
+    }
+
+    uint32_t acc = 0;
+    for (long i = 0; i < ops; ++i)
+    {
+        uint32_t result;
+        acc += barrel_shift(gba->cpu, &args[i % NUM_INPUTS], &result) + result;
+    }
+
+    timing start = now();
+    for (long i = 0; i < ops; ++i)
+    {
+        uint32_t result;
+        acc += barrel_shift(gba->cpu, &args[i % NUM_INPUTS], &result) + result;
+    }
+    timing end = now();
+
+    sink = acc;
+    print_result(bench->name, ops, start, end);
+}
+
+static void run_region_bench(gba_system *gba, const region_bench *bench, long ops)
+{
+    char name[64];
+    uint32_t mask = bench->size - 1;
+    gba_mem *mem = gba->mem;
+
+    uint32_t acc = 0;
+    for (long i = 0; i < ops; ++i)
+        acc += read_word(mem, bench->base + ((i * 4) & mask));
+
+    timing start = now();
+    for (long i = 0; i < ops; ++i)
+        acc += read_word(mem, bench->base + ((i * 4) & mask));
+    timing end = now();
+
+    sink = acc;
+    snprintf(name, sizeof name, "read_word/%s", bench->name);
+    print_result(name, ops, start, end);
+
+    if (!bench->writable)
+        return;
+
+    for (long i = 0; i < ops; ++i)
+        write_word(mem, bench->base + ((i * 4) & mask), i);
+
+    start = now();
+    for (long i = 0; i < ops; ++i)
+        write_word(mem, bench->base + ((i * 4) & mask), i);
+    end = now();
+
+    snprintf(name, sizeof name, "write_word/%s", bench->name);
+    print_result(name, ops, start, end);
+}
+
+int main(int argc, char **argv)
+{
+    struct input_args args;
+    if (parse_args(argc, argv, &args))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    gba_system gba;
+    if (init_system(&gba, &microbench_backend))
+    {
+        fputs("Failed to allocate GBA system\n", stderr);
+        return 1;
+    }
+
+    // a game to read from until a stream is loaded
+    static uint8_t blank_rom[0x10000];
+    if (load_rom_buffer(gba.mem, blank_rom, sizeof blank_rom))
+        return 1;
+    reset_system(&gba);
+
+    printf("{\n  \"commit\": ");
+    if (args.commit != NULL)
+        print_json_string(args.commit);
+    else
+        fputs("null", stdout);
+    fputs(",\n  \"results\": [", stdout);
+
+    for (size_t i = 0; i < sizeof shift_benches / sizeof *shift_benches; ++i)
+        run_shift_bench(&gba, &shift_benches[i], args.ops);
+
+    for (size_t i = 0; i < sizeof region_benches / sizeof *region_benches; ++i)
+        run_region_bench(&gba, &region_benches[i], args.ops);
+
+    for (size_t i = 0; i < sizeof decode_benches / sizeof *decode_benches; ++i)
+        run_decode_bench(&gba, &decode_benches[i], args.ops);
+
+    puts("\n  ]\n}");
+
+    deinit_system(&gba);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef CGBA_BACKEND_H
+#define CGBA_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* What the emulator core needs from the platform it runs on: somewhere
+ * to show frames and a source of button presses. The core only goes
+ * through these, so it can run under SDL or with no display at all.
+ */
+typedef struct gba_backend gba_backend;
+
+/* Emulator controls, as opposed to the GBA's own buttons */
+enum BACKEND_HOTKEYS {
+    HOTKEY_REWIND = 1 << 0,
+    HOTKEY_FAST_FORWARD = 1 << 1,
+    HOTKEY_DUMP_STATS = 1 << 2,
+};
+
+struct gba_backend {
+    /* Show a finished XRGB8888 frame. line_changed flags the scanlines
+     * that differ from the last frame passed in.
+     */
+    void (*present_frame)(gba_backend *backend,
+                          const uint32_t *frame_buffer,
+                          const bool *line_changed);
+
+    /* Handle pending input and window events, and report which buttons
+     * are held, bit n for button n of enum GBA_GAMEPAD_BUTTONS, and which
+     * HOTKEY_* controls. Returns false once the user has asked to quit,
+     * or the frames can no longer be shown.
+     */
+    bool (*poll_input)(gba_backend *backend, uint16_t *buttons_held, uint16_t *hotkeys_held);
+
+    void (*destroy)(gba_backend *backend);
+};
+
+/* A window drawn with SDL's renderer, and the keyboard for input. The
+ * window and its events are handled on a thread of their own, except
+ * on macOS, where they have to be on the main thread, so it must be
+ * created and used from there. Returns NULL if SDL or the window can't
+ * be set up. Not available in builds without SDL (make HEADLESS=1).
+ */
+gba_backend *create_sdl_backend(void);
+
+/* No display or input. Frames are left in the PPU's frame buffer
+ * for whoever embeds the core. Returns NULL if out of memory.
+ */
+gba_backend *create_headless_backend(void);
+
+#endif /* CGBA_BACKEND_H */
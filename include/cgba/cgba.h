@@ -0,0 +1,131 @@
+#ifndef CGBA_CGBA_H
+#define CGBA_CGBA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Embedding API, built as libcgba.so with `make lib`. Each instance is a
+ * whole GBA with no window, input or throttling of its own: the caller
+ * steps it a frame at a time with the buttons to hold down.
+ */
+
+#define CGBA_API __attribute__((visibility("default")))
+
+#define CGBA_SCREEN_WIDTH 240
+#define CGBA_SCREEN_HEIGHT 160
+
+/* Button bits for cgba_step_frame */
+#define CGBA_BUTTON_A      (1 << 0)
+#define CGBA_BUTTON_B      (1 << 1)
+#define CGBA_BUTTON_SELECT (1 << 2)
+#define CGBA_BUTTON_START  (1 << 3)
+#define CGBA_BUTTON_RIGHT  (1 << 4)
+#define CGBA_BUTTON_LEFT   (1 << 5)
+#define CGBA_BUTTON_UP     (1 << 6)
+#define CGBA_BUTTON_DOWN   (1 << 7)
+#define CGBA_BUTTON_R      (1 << 8)
+#define CGBA_BUTTON_L      (1 << 9)
+
+typedef enum cgba_status {
+    CGBA_OK = 0,
+    CGBA_ERR_NO_MEMORY = -1,
+    CGBA_ERR_ROM_TOO_LARGE = -2,
+    CGBA_ERR_NO_ROM = -3,         // stepped before a game was loaded
+    CGBA_ERR_ROM_LOADED = -4,     // a game was already loaded
+    CGBA_ERR_EMULATION = -5,      // the game hit something not emulated
+    CGBA_ERR_BUFFER_SIZE = -6,    // too small for a save state
+    CGBA_ERR_BAD_STATE = -7,      // not a save state from this version
+} cgba_status;
+
+typedef struct cgba cgba;
+typedef struct cgba_rom cgba_rom;
+typedef struct cgba_runner cgba_runner;
+typedef struct cgba_observer cgba_observer;
+
+/* Returns NULL if out of memory */
+CGBA_API cgba *cgba_create(void);
+CGBA_API void cgba_destroy(cgba *gba);
+
+/* Copy a game into the instance and start it. rom can be freed afterwards. */
+CGBA_API cgba_status cgba_load_rom(cgba *gba, const void *rom, size_t size);
+
+/* A read-only copy of a game that any number of instances can run from,
+ * on any threads. Returns NULL if the game is too large or out of memory.
+ */
+CGBA_API cgba_rom *cgba_rom_create(const void *rom, size_t size);
+
+/* The copy is freed once it's been released and every instance
+ * running from it has been destroyed
+ */
+CGBA_API void cgba_rom_release(cgba_rom *rom);
+
+/* Start a game shared with other instances */
+CGBA_API cgba_status cgba_insert_rom(cgba *gba, cgba_rom *rom);
+
+/* Emulate one frame with the given CGBA_BUTTON_* bits held. On success,
+ * frame points to the instance's own XRGB8888 frame buffer, which stays
+ * valid until the next step. After CGBA_ERR_EMULATION the instance can
+ * only be destroyed.
+ */
+CGBA_API cgba_status cgba_step_frame(cgba *gba, uint16_t buttons_held, const uint32_t **frame);
+
+/* What went wrong in the last step that failed with CGBA_ERR_EMULATION */
+CGBA_API const char *cgba_error_message(const cgba *gba);
+
+/* Bytes in a save state. Save states hold everything about a running
+ * game except the game itself, and are only meant to be loaded by the
+ * same version of the library, into an instance running the same game.
+ */
+CGBA_API size_t cgba_state_size(void);
+
+/* Save the instance's state to buf, of the given size */
+CGBA_API cgba_status cgba_save_state(const cgba *gba, void *buf, size_t size);
+
+/* Go back to a saved state. This also recovers an instance
+ * that has failed with CGBA_ERR_EMULATION.
+ */
+CGBA_API cgba_status cgba_load_state(cgba *gba, const void *buf, size_t size);
+
+/* A pool of threads for stepping many instances at once. The calling
+ * thread counts as one of num_threads; 0 means one thread per CPU.
+ * Returns NULL if the threads can't be started.
+ */
+CGBA_API cgba_runner *cgba_runner_create(int num_threads);
+CGBA_API void cgba_runner_destroy(cgba_runner *runner);
+
+/* Step count distinct instances one frame each, spread across the pool,
+ * as if by cgba_step_frame(gbas[i], buttons_held[i], &frames[i]) with
+ * the result in statuses[i]. Returns once every instance is done.
+ */
+CGBA_API void cgba_runner_step(cgba_runner *runner,
+                               cgba **gbas,
+                               const uint16_t *buttons_held,
+                               const uint32_t **frames,
+                               cgba_status *statuses,
+                               size_t count);
+
+/* Turns frames into observations for learning agents: each frame is
+ * scaled (bilinearly) to width x height, converted to 1 gray or 3 RGB
+ * channels, and stacked with the stack - 1 frames before it. Returns
+ * NULL for a size, channel count or stack that doesn't make sense.
+ */
+CGBA_API cgba_observer *cgba_observer_create(int width, int height, int channels, int stack);
+CGBA_API void cgba_observer_destroy(cgba_observer *observer);
+
+/* Bytes in one instance's observation */
+CGBA_API size_t cgba_observation_size(const cgba_observer *observer);
+
+/* Add frames[i] to the i'th of count observations laid out one after
+ * another in obs, as uint8 [count][stack][height][width][channels]
+ * with the oldest frame first. Where restart[i] is set, the frame
+ * starts a new stack and fills all of it. restart can be NULL when
+ * none are starting over.
+ */
+CGBA_API void cgba_observe(const cgba_observer *observer,
+                           const uint32_t **frames,
+                           const bool *restart,
+                           size_t count,
+                           uint8_t *obs);
+
+#endif /* CGBA_CGBA_H */
@@ -79,6 +79,7 @@ typedef enum arm_bank_register {
     BANK_R14,
 } arm_bank_register;
 
+/* Everything up to mem is the CPU's part of a save state */
 typedef struct arm7tdmi {
     uint32_t pipeline[2];
     uint32_t registers[ARM_NUM_REGISTERS];
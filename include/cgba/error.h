@@ -0,0 +1,22 @@
+#ifndef CGBA_ERROR_H
+#define CGBA_ERROR_H
+
+#include <setjmp.h>
+#include <stdnoreturn.h>
+
+/* Report an error that emulation can't carry on from, printf style.
+ * Prints the message and exits, unless the calling thread has set a
+ * handler, in which case the message is kept and the handler is
+ * jumped to instead.
+ */
+noreturn void fatal_error(const char *fmt, ...);
+
+/* Jump to handler (set up with setjmp) on fatal errors on this thread,
+ * or exit again when NULL
+ */
+void set_fatal_error_handler(jmp_buf *handler);
+
+/* The last fatal error handled on this thread */
+const char *fatal_error_message(void);
+
+#endif /* CGBA_ERROR_H */
@@ -4,7 +4,6 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "cgba/memory.h"
-#include "SDL_events.h"
 
 enum GBA_GAMEPAD_BUTTONS {
     BUTTON_A,
@@ -27,6 +26,7 @@ typedef struct gba_gamepad {
 gba_gamepad *init_gamepad(void);
 void deinit_gamepad(gba_gamepad *gamepad);
 
-void on_keypress(gba_gamepad *pad, SDL_KeyboardEvent *key_event);
+/* Set the buttons held, bit n for button n of enum GBA_GAMEPAD_BUTTONS */
+void update_gamepad(gba_gamepad *pad, uint16_t buttons_held);
 
 #endif /* CGBA_GAMEPAD_H */
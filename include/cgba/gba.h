@@ -3,29 +3,89 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "cgba/backend.h"
 #include "cgba/cpu.h"
 #include "cgba/gamepad.h"
 #include "cgba/memory.h"
+#include "cgba/movie.h"
+#include "cgba/pacer.h"
 #include "cgba/ppu.h"
+#include "cgba/profiler.h"
+#include "cgba/rewind.h"
 
-/* frame duration is 16.743 ms */
-#define GBA_FRAME_DURATION_MS 17
+/* skip frames only while running behind real time, or, while
+ * running as fast as possible, frames the screen couldn't keep up with
+ */
+#define FRAMESKIP_AUTO -1
+
+/* most frames the screen can be run ahead of the game */
+#define MAX_RUN_AHEAD 8
 
 typedef struct gba_system {
     arm7tdmi *cpu;
     gba_mem *mem;
     gba_ppu *ppu;
     gba_gamepad *gamepad;
+    gba_backend *backend;
+    rewind_buffer *rewind; // NULL when rewinding is off
+    gba_movie *recording;  // where input goes, if anywhere
+    gba_movie *playback;   // where input comes from instead of the backend
+    const char *statsfile; // where F9 writes the counts, in builds with STATS=1
+    gba_profiler *profiler; // NULL when not profiling
+    uint16_t hotkeys_held;
     uint64_t clocks_emulated;
-    uint64_t next_frame_time;
+    uint64_t instructions_emulated;
+    frame_pacer pacer;
+    double speed; // multiple of the GBA's speed, 0 for as fast as possible
+    bool fast_forwarding;
+    int frameskip;      // frames skipped after each drawn frame, or FRAMESKIP_AUTO
+    int frames_skipped; // frames skipped in a row so far
+    uint64_t frame_drawn_ns; // when the last frame drawn was started
+
+    // frames shown ahead of the game's state, 0 for none, and the
+    // state saved before running ahead, which is then restored
+    int run_ahead;
+    void *run_ahead_state;
+
+    // time spent on frames that ran ahead, for the run-ahead itself and
+    // the frame underneath, to report what run-ahead costs
+    uint64_t run_ahead_frames;
+    uint64_t run_ahead_ns;
+    uint64_t base_frame_ns;
     bool skip_bios;
     bool running;
 } gba_system;
 
-void init_system_or_die(gba_system *gba, const char *romfile, const char *biosfile);
+/* Set up a system that runs on the given backend, which it takes
+ * ownership of once set up. The game still has to be loaded into
+ * memory before reset_system. Returns 0, or -1 if out of memory.
+ */
+int init_system(gba_system *gba, gba_backend *backend);
+
+/* Start the loaded game from the beginning */
+void reset_system(gba_system *gba);
+
+/* init_system, load the game and BIOS files, and reset */
+void init_system_or_die(gba_system *gba,
+                        const char *romfile,
+                        const char *biosfile,
+                        gba_backend *backend);
 void deinit_system(gba_system *gba);
+
+/* Emulate up to the start of the next VBlank */
+void run_frame(gba_system *gba);
+
+/* Show the screen the given number of frames ahead of the game, so it
+ * reacts to input sooner. Returns 0, or -1 if out of memory.
+ */
+int enable_run_ahead(gba_system *gba, int frames);
+
+/* Emulate in real time until the user quits */
 void run_system(gba_system *gba);
 
-void report_rom_info(uint8_t *rom);
+/* Print how much running ahead has added to each frame */
+void report_run_ahead_cost(const gba_system *gba);
+
+void report_rom_info(const uint8_t *rom);
 
 #endif /* CGBA_GBA_H */
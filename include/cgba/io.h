@@ -26,6 +26,35 @@ enum io_registers {
     BG3HOFS   = 0x0400001c,
     BG3VOFS   = 0x0400001e,
 
+    BG2PA     = 0x04000020,
+    BG2PB     = 0x04000022,
+    BG2PC     = 0x04000024,
+    BG2PD     = 0x04000026,
+    BG2X_L    = 0x04000028,
+    BG2X_H    = 0x0400002a,
+    BG2Y_L    = 0x0400002c,
+    BG2Y_H    = 0x0400002e,
+
+    BG3PA     = 0x04000030,
+    BG3PB     = 0x04000032,
+    BG3PC     = 0x04000034,
+    BG3PD     = 0x04000036,
+    BG3X_L    = 0x04000038,
+    BG3X_H    = 0x0400003a,
+    BG3Y_L    = 0x0400003c,
+    BG3Y_H    = 0x0400003e,
+
+    WIN0H     = 0x04000040,
+    WIN1H     = 0x04000042,
+    WIN0V     = 0x04000044,
+    WIN1V     = 0x04000046,
+    WININ     = 0x04000048,
+    WINOUT    = 0x0400004a,
+
+    BLDCNT    = 0x04000050,
+    BLDALPHA  = 0x04000052,
+    BLDY      = 0x04000054,
+
     KEYINPUT  = 0x04000130,
 
     IE        = 0x04000200,
@@ -2,15 +2,19 @@
 #define CGBA_MEMORY_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "cgba/rom.h"
 
 typedef struct arm7tdmi arm7tdmi;
 typedef struct gba_ppu gba_ppu;
 typedef struct gba_gamepad gba_gamepad;
 
+/* Everything up to bios is the memory's part of a save state,
+ * and is saved with one copy, so it has to stay together
+ */
 typedef struct gba_mem {
     // general internal memory
-    uint8_t bios[0x4000];
     uint8_t ewram[0x40000];
     uint8_t iwram[0x8000];
 
@@ -19,19 +23,24 @@ typedef struct gba_mem {
     uint8_t vram[0x18000];
     uint8_t oam[0x400];
 
-    // game pak
-    uint8_t rom[0x2000000];
+    // game pak save memory
     uint8_t sram[0x10000];
 
-    // whether we loaded a BIOS file
-    bool has_bios;
-
     uint32_t last_fetched_bios_opcode;
 
     uint16_t irq_enable;
     uint16_t irq_request;
     uint32_t ime_flag;
 
+    uint8_t bios[0x4000];
+
+    // whether we loaded a BIOS file
+    bool has_bios;
+
+    // game pak ROM, shared by every system running the game
+    gba_rom *rom_image;
+    const uint8_t *rom;
+
     arm7tdmi *cpu;
     gba_ppu *ppu;
     gba_gamepad *gamepad;
@@ -45,7 +54,16 @@ void write_word(gba_mem *mem, uint32_t addr, uint32_t val);
 void write_halfword(gba_mem *mem, uint32_t addr, uint16_t val);
 void write_byte(gba_mem *mem, uint32_t addr, uint8_t val);
 
-gba_mem *init_memory(const char *romfile, const char *biosfile);
+gba_mem *init_memory(void);
 void deinit_memory(gba_mem *mem);
 
+/* Put a game in the game pak, taking a reference to its ROM image */
+void insert_rom_image(gba_mem *mem, gba_rom *rom);
+
+/* Load a game into the game pak ROM. Both return 0 on success, or
+ * -1 if the file can't be read or the game doesn't fit.
+ */
+int load_rom_file(gba_mem *mem, const char *romfile);
+int load_rom_buffer(gba_mem *mem, const void *rom, size_t size);
+
 #endif /* CGBA_MEMORY_H */
@@ -0,0 +1,44 @@
+#ifndef CGBA_MOVIE_H
+#define CGBA_MOVIE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cgba/memory.h"
+
+#define MOVIE_VERSION 1
+
+/* frames of input buffered before being handed to the writer thread */
+#define MOVIE_CHUNK_FRAMES 4096
+
+typedef struct gba_system gba_system;
+
+/* A recording of the buttons held on every frame since the game was
+ * reset, identified by hashes of the ROM and BIOS it was made with.
+ * Emulation is deterministic, so playing it back reproduces the run
+ * exactly. Recorded frames are written out on a separate thread.
+ */
+typedef struct gba_movie gba_movie;
+
+/* Both print why and return NULL if the file can't be opened, or
+ * isn't a movie of the game and BIOS in memory
+ */
+gba_movie *start_movie_recording(const char *moviefile, const gba_mem *mem);
+gba_movie *open_movie(const char *moviefile, const gba_mem *mem);
+
+/* Finish writing a recording, and close the file */
+void close_movie(gba_movie *movie);
+
+/* Add the buttons held for the next frame to a recording */
+void record_movie_frame(gba_movie *movie, uint16_t buttons_held);
+
+/* Get the buttons held for the next frame of a movie being played.
+ * Returns false on the last frame, which is where the recording stopped.
+ */
+bool play_movie_frame(gba_movie *movie, uint16_t *buttons_held);
+
+/* Print how fast a movie played back, and a hash of the state
+ * it left the system in, to compare runs by
+ */
+void report_movie_playback(const gba_movie *movie, const gba_system *gba);
+
+#endif /* CGBA_MOVIE_H */
@@ -0,0 +1,42 @@
+#ifndef CGBA_PACER_H
+#define CGBA_PACER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A frame is 228 scanlines of 1232 cycles */
+#define GBA_CYCLES_PER_FRAME 280896
+
+/* Frames finishing this far behind schedule are given up on, and
+ * pacing starts over from now rather than racing to catch up
+ */
+#define PACER_MAX_LAG_FRAMES 4
+
+/* The last stretch before a deadline is spun through,
+ * rather than trusting the OS to wake up on time
+ */
+#define PACER_SPIN_NS 500000
+
+/* Keeps emulated frames in step with real time. Each frame is due a
+ * whole number of GBA frame periods after the pacer started, so
+ * rounding and oversleeping don't add up over time.
+ */
+typedef struct frame_pacer {
+    uint64_t start_ns;   // when frame 0 was due
+    uint64_t frames;     // frames since then
+    double frame_ns;     // period at the current speed, 0 if unthrottled
+    bool spin;
+} frame_pacer;
+
+/* speed is a multiple of the GBA's, or 0 to run as fast as possible.
+ * spin trades some CPU time for waking up on time.
+ */
+void init_frame_pacer(frame_pacer *pacer, double speed, bool spin);
+void set_pacer_speed(frame_pacer *pacer, double speed);
+
+/* Wait until the next frame is due. Returns true if it was already
+ * overdue, i.e. emulation is running behind.
+ */
+bool wait_for_next_frame(frame_pacer *pacer);
+
+#endif /* CGBA_PACER_H */
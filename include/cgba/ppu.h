@@ -4,12 +4,22 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "cgba/memory.h"
-#include "SDL_render.h"
-#include "SDL_video.h"
 
 #define FRAME_WIDTH 240
 #define FRAME_HEIGHT 160
 
+/* VRAM holds 3072 4bpp tiles (32 bytes each), BG and OBJ tiles combined */
+#define TILE_4BPP_SIZE 32
+#define VRAM_NUM_TILES (0x18000 / TILE_4BPP_SIZE)
+
+/* 256 BG colors followed by 256 OBJ colors */
+#define PALETTE_NUM_COLORS 512
+
+typedef struct gba_backend gba_backend;
+typedef struct ppu_render_ctx ppu_render_ctx;
+typedef struct ppu_render_thread ppu_render_thread;
+
+/* Everything up to mem is the PPU's part of a save state */
 typedef struct gba_ppu {
     uint16_t dispcnt;
     uint16_t dispstat;
@@ -22,22 +32,94 @@ typedef struct gba_ppu {
     uint16_t bghoffsets[4];
     uint16_t bgvoffsets[4];
 
-    gba_mem *mem;
+    // BG2 and BG3 rotation/scaling: 8.8 fixed-point matrices, and
+    // 20.8 fixed-point reference points as written to BGxX/BGxY
+    uint16_t bgpa[2];
+    uint16_t bgpb[2];
+    uint16_t bgpc[2];
+    uint16_t bgpd[2];
+    uint32_t bgx[2];
+    uint32_t bgy[2];
+
+    // reference points of the current scanline, reloaded from
+    // BGxX/BGxY every frame and stepped by PB/PD every scanline
+    int32_t bgx_internal[2];
+    int32_t bgy_internal[2];
+
+    // window boundaries and controls
+    uint16_t winh[2];
+    uint16_t winv[2];
+    uint16_t winin;
+    uint16_t winout;
+
+    // color special effects
+    uint16_t bldcnt;
+    uint16_t bldalpha;
+    uint16_t bldy;
 
-    uint16_t frame_buffer[FRAME_WIDTH*FRAME_HEIGHT]; // XBGR1555
     int scanline_clock;
+    int line_px_drawn; // pixels of the current scanline drawn so far
+
+    gba_mem *mem;
+
+    // direct views of display memory, bypassing the CPU bus
+    const uint8_t *vram;
+    const uint8_t *palette_ram;
+    const uint8_t *oam;
+
+    // display memory written since it was last handed to the renderer,
+    // tracked per 4bpp tile for VRAM and per color for palette RAM
+    uint32_t vram_dirty[VRAM_NUM_TILES / 32];
+    uint32_t palette_dirty[PALETTE_NUM_COLORS / 32];
+    bool vram_written;
+    bool palette_written;
+    bool oam_written;
+
+    bool color_correction;
+
+    ppu_render_ctx *render_ctx;
+    ppu_render_thread *render_thread; // NULL when drawing on the emulation thread
+
+    uint32_t frame_buffer[FRAME_WIDTH*FRAME_HEIGHT]; // XRGB8888
     bool curr_frame_rendered;
-    bool frame_presented_signal; // for processing SDL events once per frame
+    bool frame_presented_signal; // for processing input once per frame
+    bool skip_frame; // emulate the current frame without drawing or presenting it
 
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-    SDL_Texture *screen;
+    gba_backend *backend; // where finished frames go, NULL to keep them here
 } gba_ppu;
 
 gba_ppu *init_ppu(void);
 void deinit_ppu(gba_ppu *ppu);
 
-void init_screen_or_die(gba_ppu *ppu);
+/* Draw scanlines on a separate thread instead of the emulation
+ * thread. Returns 0 on success or -1 if the thread can't be started.
+ */
+int enable_render_thread(gba_ppu *ppu);
+
+/* Invalidate the decoded tile covering the given VRAM offset */
+void mark_vram_dirty(gba_ppu *ppu, uint32_t offset);
+
+/* Invalidate the converted color at the given palette RAM offset */
+void mark_palette_dirty(gba_ppu *ppu, uint32_t offset);
+
+/* Note that OAM has been written */
+void mark_oam_dirty(gba_ppu *ppu);
+
+/* Note that all of display memory has been replaced */
+void mark_display_memory_dirty(gba_ppu *ppu);
+
+/* Draw the part of the current scanline that has been displayed so far,
+ * before a register or palette write changes how the rest of it looks
+ */
+void catch_up_scanline(gba_ppu *ppu);
+
+/* Reload an internal reference point of an affine BG (0 = BG2, 1 = BG3)
+ * after its BGxX or BGxY register has been written. Each only reloads
+ * its own, so the other keeps accumulating down the frame.
+ */
+void reload_bg_reference_x(gba_ppu *ppu, int affno);
+void reload_bg_reference_y(gba_ppu *ppu, int affno);
+
 void run_ppu(gba_ppu *ppu, int num_clocks);
 
 
@@ -0,0 +1,37 @@
+#ifndef CGBA_PROFILER_H
+#define CGBA_PROFILER_H
+
+#include <stdint.h>
+#include "cgba/cpu.h"
+
+/* cycles between samples by default, prime so that it doesn't fall
+ * into step with the game's loops
+ */
+#define PROFILE_INTERVAL 1009
+
+/* Counts of where the game's PC was, sampled every so many emulated
+ * cycles, to show where the game spends its time
+ */
+typedef struct gba_profiler gba_profiler;
+
+/* Returns NULL if out of memory */
+gba_profiler *create_profiler(int interval);
+void destroy_profiler(gba_profiler *profiler);
+
+/* Name samples after the functions in a homebrew game's ELF file or
+ * GNU ld map file. Prints why and returns -1 if it can't be read.
+ */
+int load_profile_symbols(gba_profiler *profiler, const char *symbolfile);
+
+/* Count cycles run by the CPU, sampling the next instruction's
+ * address each time another interval has gone by
+ */
+void profile_cycles(gba_profiler *profiler, const arm7tdmi *cpu, int num_clocks);
+
+/* Write the samples as folded stacks ("region;function count" lines),
+ * which flame graph tools take. Without symbols functions are named
+ * by address. Prints why and returns -1 on failure.
+ */
+int write_profile(const gba_profiler *profiler, const char *profilefile);
+
+#endif /* CGBA_PROFILER_H */
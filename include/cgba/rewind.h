@@ -0,0 +1,37 @@
+#ifndef CGBA_REWIND_H
+#define CGBA_REWIND_H
+
+#include <stddef.h>
+
+/* frames between snapshots */
+#define REWIND_INTERVAL 4
+
+/* memory for compressed snapshots, several minutes for most games */
+#define REWIND_BUFFER_SIZE (32 * 1024 * 1024)
+
+typedef struct gba_system gba_system;
+
+/* History of save states for rewinding. The newest snapshot is kept
+ * whole, and each older one as the difference from the one after it,
+ * run-length encoded into a ring that drops the oldest when full.
+ * Snapshots are encoded on a background thread.
+ */
+typedef struct rewind_buffer rewind_buffer;
+
+/* Returns NULL if out of memory or the thread can't be started */
+rewind_buffer *create_rewind_buffer(int interval, size_t buffer_size);
+void destroy_rewind_buffer(rewind_buffer *rw);
+
+/* Count a frame, snapshotting the system every interval frames. If
+ * the last snapshot is still being encoded, this one is put off to
+ * the next frame rather than waiting.
+ */
+void record_rewind_frame(rewind_buffer *rw, gba_system *gba);
+
+/* Load the newest snapshot, or the one before it if the newest was
+ * the last one loaded. Returns -1 with the system unchanged if there's
+ * no snapshot; once history runs out the oldest is loaded again.
+ */
+int rewind_step_back(rewind_buffer *rw, gba_system *gba);
+
+#endif /* CGBA_REWIND_H */
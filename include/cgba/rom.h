@@ -0,0 +1,31 @@
+#ifndef CGBA_ROM_H
+#define CGBA_ROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 32 MiB of game pak ROM address space */
+#define GBA_ROM_SIZE 0x2000000
+
+/* A game's ROM image. It's never written, so every system running the
+ * same game can share one image; it's freed once the last one is done.
+ */
+typedef struct gba_rom gba_rom;
+
+/* Both return NULL if the game can't be read, doesn't fit in the
+ * ROM address space or memory runs out
+ */
+gba_rom *load_rom_image(const char *romfile);
+gba_rom *create_rom_image(const void *data, size_t size);
+
+/* Take another reference to the image, and give one back */
+gba_rom *retain_rom_image(gba_rom *rom);
+void release_rom_image(gba_rom *rom);
+
+/* GBA_ROM_SIZE bytes, zero past the end of the game */
+const uint8_t *rom_image_data(const gba_rom *rom);
+
+/* Size of the game, up to GBA_ROM_SIZE */
+size_t rom_image_size(const gba_rom *rom);
+
+#endif /* CGBA_ROM_H */
@@ -0,0 +1,31 @@
+#ifndef CGBA_SAVESTATE_H
+#define CGBA_SAVESTATE_H
+
+#include <stddef.h>
+#include "cgba/gba.h"
+
+/* Bump whenever the state saved changes, so that
+ * older save states are turned away rather than misread
+ */
+#define SAVESTATE_VERSION 2
+
+/* A save state is a snapshot of the whole machine apart from the game's
+ * ROM and the BIOS, which are never written. It's the raw CPU, memory,
+ * PPU and game pad state as laid out in this build, behind a header
+ * that identifies it, so saving and loading are a handful of copies.
+ *
+ * The picture isn't saved: the frame after a save state is loaded is
+ * drawn in full, as long as it was saved between frames.
+ */
+size_t savestate_size(void);
+
+/* Save the system into buf, which must hold savestate_size() bytes */
+void save_state(const gba_system *gba, void *buf);
+
+/* Load a save state made by save_state. Returns 0, or -1 if buf doesn't
+ * hold a save state of this version with this build's struct layouts,
+ * leaving the system as it was.
+ */
+int load_state(gba_system *gba, const void *buf, size_t size);
+
+#endif /* CGBA_SAVESTATE_H */
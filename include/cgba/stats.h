@@ -0,0 +1,141 @@
+#ifndef CGBA_STATS_H
+#define CGBA_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Counts of what the emulated games execute, for finding out which fast
+ * paths are worth having. Only built with `make STATS=1` (CGBA_STATS),
+ * and otherwise the counting compiles to nothing.
+ *
+ * Counters are per thread, like the systems running on them, and cover
+ * every system that thread has run.
+ */
+
+typedef enum stat_counter {
+    // ARM instructions, by handler
+    STAT_ARM_BX,
+    STAT_ARM_BRANCH,
+    STAT_ARM_PROCESS_DATA,
+    STAT_ARM_BLOCK_DATA_TRANSFER,
+    STAT_ARM_SINGLE_DATA_TRANSFER,
+    STAT_ARM_HALFWORD_TRANSFER,
+    STAT_ARM_MRS_TRANSFER,
+    STAT_ARM_MSR_TRANSFER,
+    STAT_ARM_MULTIPLY,
+    STAT_ARM_SINGLE_DATA_SWAP,
+    STAT_ARM_UNDEFINED,
+
+    // THUMB instructions, by handler
+    STAT_THUMB_UNCONDITIONAL_BRANCH,
+    STAT_THUMB_CONDITIONAL_BRANCH,
+    STAT_THUMB_MULTIPLE_LOAD_STORE,
+    STAT_THUMB_LONG_BRANCH_WITH_LINK,
+    STAT_THUMB_ADD_OFFSET_TO_SP,
+    STAT_THUMB_OPERATE_WITH_IMMEDIATE,
+    STAT_THUMB_HI_REGISTER_OP_OR_BX,
+    STAT_THUMB_PUSH_POP_REGISTERS,
+    STAT_THUMB_LOAD_STORE_HALFWORD,
+    STAT_THUMB_SP_RELATIVE_LOAD_STORE,
+    STAT_THUMB_LOAD_ADDRESS,
+    STAT_THUMB_LOAD_STORE_WITH_OFFSET,
+    STAT_THUMB_LOAD_STORE_SIGN_EXTENDED,
+    STAT_THUMB_PC_RELATIVE_LOAD,
+    STAT_THUMB_ALU_OPERATION,
+    STAT_THUMB_ADD_SUBTRACT,
+    STAT_THUMB_MOVE_SHIFTED_REGISTER,
+
+    // either instruction set
+    STAT_SOFTWARE_INTERRUPT,
+    STAT_COND_PASSED,
+    STAT_COND_FAILED,
+    STAT_PIPELINE_RELOADS,
+    STAT_IRQ_ENTRIES,
+
+    NUM_STAT_COUNTERS,
+} stat_counter;
+
+typedef enum stat_access {
+    STAT_READ,
+    STAT_WRITE,
+    NUM_STAT_ACCESSES,
+} stat_access;
+
+typedef enum stat_width {
+    STAT_BYTE,
+    STAT_HALFWORD,
+    STAT_WORD,
+    NUM_STAT_WIDTHS,
+} stat_width;
+
+typedef enum stat_region {
+    STAT_REGION_BIOS,
+    STAT_REGION_EWRAM,
+    STAT_REGION_IWRAM,
+    STAT_REGION_IO,
+    STAT_REGION_PALETTE,
+    STAT_REGION_VRAM,
+    STAT_REGION_OAM,
+    STAT_REGION_ROM,
+    STAT_REGION_SRAM,
+    STAT_REGION_UNMAPPED,
+    NUM_STAT_REGIONS,
+} stat_region;
+
+typedef struct emulation_stats {
+    uint64_t counters[NUM_STAT_COUNTERS];
+    uint64_t mem_accesses[NUM_STAT_ACCESSES][NUM_STAT_WIDTHS][NUM_STAT_REGIONS];
+} emulation_stats;
+
+#ifdef CGBA_STATS
+
+extern _Thread_local emulation_stats thread_stats;
+
+static inline stat_region region_of(uint32_t addr)
+{
+    switch (addr >> 24)
+    {
+        case 0x00: return STAT_REGION_BIOS;
+        case 0x02: return STAT_REGION_EWRAM;
+        case 0x03: return STAT_REGION_IWRAM;
+        case 0x04: return STAT_REGION_IO;
+        case 0x05: return STAT_REGION_PALETTE;
+        case 0x06: return STAT_REGION_VRAM;
+        case 0x07: return STAT_REGION_OAM;
+        case 0x08: case 0x09:
+        case 0x0a: case 0x0b:
+        case 0x0c: case 0x0d: return STAT_REGION_ROM;
+        case 0x0e: case 0x0f: return STAT_REGION_SRAM;
+        default: return STAT_REGION_UNMAPPED;
+    }
+}
+
+#define COUNT_STAT(counter) (++thread_stats.counters[counter])
+#define COUNT_MEM_ACCESS(access, width, addr) (++thread_stats.mem_accesses[access][width][region_of(addr)])
+
+#else
+
+#define COUNT_STAT(counter) ((void)0)
+#define COUNT_MEM_ACCESS(access, width, addr) ((void)0)
+
+#endif /* CGBA_STATS */
+
+/* Write this thread's counts as name,count lines, or as one JSON object */
+void write_stats_csv(FILE *f);
+void write_stats_json(FILE *f);
+
+/* Write this thread's counts to a file, as JSON if its name ends in
+ * .json and CSV otherwise. Prints why and returns -1 on failure.
+ */
+int dump_stats(const char *statsfile);
+
+/* Start this thread's counts again from zero */
+void reset_stats(void);
+
+/* Copy this thread's counts out, and put them back later,
+ * to leave out emulation that's thrown away again
+ */
+void save_stats(emulation_stats *stats);
+void restore_stats(const emulation_stats *stats);
+
+#endif /* CGBA_STATS_H */
@@ -0,0 +1,39 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "cgba/backend.h"
+
+static void headless_present_frame(gba_backend *backend,
+                                   const uint32_t *frame_buffer,
+                                   const bool *line_changed)
+{
+    (void)backend;
+    (void)frame_buffer;
+    (void)line_changed;
+}
+
+static bool headless_poll_input(gba_backend *backend, uint16_t *buttons_held, uint16_t *hotkeys_held)
+{
+    (void)backend;
+    *buttons_held = 0;
+    *hotkeys_held = 0;
+    return true;
+}
+
+static void headless_destroy(gba_backend *backend)
+{
+    free(backend);
+}
+
+gba_backend *create_headless_backend(void)
+{
+    gba_backend *backend = malloc(sizeof(gba_backend));
+    if (backend == NULL)
+        return NULL;
+
+    backend->present_frame = headless_present_frame;
+    backend->poll_input = headless_poll_input;
+    backend->destroy = headless_destroy;
+
+    return backend;
+}
@@ -0,0 +1,510 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cgba/backend.h"
+#include "cgba/gamepad.h"
+#include "cgba/ppu.h"
+#include "SDL.h"
+
+#define WINDOW_SCALE 3
+
+/* SDL wants a window, its renderer and its events all handled on the
+ * thread that created the window. That's the presenting thread, and the
+ * emulation thread only hands it frames and reads back the input it saw.
+ * macOS only allows windows on the main thread, so there the emulation
+ * thread, which is the main thread, does it all itself.
+ */
+#ifndef __APPLE__
+#define PRESENTER_THREAD
+#endif
+
+/* Frames are handed to the presenting thread through a triple buffer:
+ * the emulation thread fills the back slot and swaps it with the middle
+ * one, and the presenting thread swaps the middle slot with the one it
+ * shows whenever the middle one holds a newer frame. Neither side ever
+ * waits for the other, and the newest frame always wins.
+ */
+#define NUM_SLOTS 3
+#define SLOT_MASK 0x3
+#define SLOT_FRESH 0x4 // the middle slot holds a frame not yet taken
+
+/* Iterations to poll for a frame before going to sleep */
+#define SPIN_COUNT 4096
+
+/* Longest the presenting thread sleeps before handling events again */
+#define EVENT_POLL_NS 2000000
+
+#define NS_PER_SEC 1000000000
+
+typedef struct frame_slot {
+    uint32_t pixels[FRAME_WIDTH*FRAME_HEIGHT];
+    uint64_t frame_no;
+
+    // number of the frame each scanline last changed in
+    uint64_t line_updated[FRAME_HEIGHT];
+} frame_slot;
+
+typedef struct sdl_backend {
+    gba_backend backend; // must be first
+
+    // owned by the presenting thread
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *screen;
+    uint64_t presented_frame_no;
+    uint16_t buttons_held;
+    uint16_t hotkeys_held;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake_presenter;
+    pthread_cond_t started;
+    atomic_bool presenter_sleeping;
+    atomic_bool quit;
+    int start_result; // set by the presenting thread once it's up, under lock
+
+    // input as of the last events handled, buttons_held | hotkeys_held << 16
+    atomic_uint input;
+    atomic_bool quit_requested;
+
+    frame_slot slots[NUM_SLOTS];
+    atomic_uint middle;   // slot number, plus SLOT_FRESH
+    unsigned back;        // owned by the emulation thread
+    unsigned front;       // owned by the presenting thread
+
+    // emulation thread's count of frames and when each scanline changed
+    uint64_t frame_no;
+    uint64_t line_updated[FRAME_HEIGHT];
+} sdl_backend;
+
+static void redraw_screen(sdl_backend *sdl)
+{
+    SDL_RenderClear(sdl->renderer);
+    SDL_RenderCopy(sdl->renderer, sdl->screen, NULL, NULL);
+    SDL_RenderPresent(sdl->renderer);
+}
+
+/* Upload the scanlines of the slot that changed since the last
+ * frame presented, which may be several frames back. On failure,
+ * asks the emulator to quit, since this may be on the presenting
+ * thread.
+ */
+static bool upload_frame(sdl_backend *sdl, const frame_slot *slot)
+{
+    bool frame_changed = false;
+
+    for (int y = 0; y < FRAME_HEIGHT;)
+    {
+        if (slot->line_updated[y] <= sdl->presented_frame_no)
+        {
+            ++y;
+            continue;
+        }
+
+        int start = y;
+        while (y < FRAME_HEIGHT && slot->line_updated[y] > sdl->presented_frame_no)
+            ++y;
+
+        SDL_Rect rows = {0, start, FRAME_WIDTH, y - start};
+        if (SDL_UpdateTexture(sdl->screen,
+                              &rows,
+                              slot->pixels + FRAME_WIDTH * start,
+                              FRAME_WIDTH * sizeof(uint32_t)) < 0)
+        {
+            fprintf(stderr, "Error rendering frame: %s\n", SDL_GetError());
+            atomic_store(&sdl->quit_requested, true);
+            return false;
+        }
+
+        frame_changed = true;
+    }
+
+    sdl->presented_frame_no = slot->frame_no;
+    return frame_changed;
+}
+
+static bool take_fresh_frame(sdl_backend *sdl)
+{
+    if (!(atomic_load(&sdl->middle) & SLOT_FRESH))
+        return false;
+
+    sdl->front = atomic_exchange(&sdl->middle, sdl->front) & SLOT_MASK;
+    return true;
+}
+
+/* Show the newest frame handed over, if any, or redraw the one shown */
+static void show_frame(sdl_backend *sdl, bool redraw)
+{
+    // nothing more is shown once quitting, or after failing to
+    if (atomic_load(&sdl->quit_requested))
+        return;
+
+    // an identical frame is already on screen
+    if (take_fresh_frame(sdl) && upload_frame(sdl, &sdl->slots[sdl->front]))
+        redraw = true;
+
+    if (redraw)
+        redraw_screen(sdl);
+}
+
+/* Returns false if the key isn't a hotkey */
+static bool on_hotkey(sdl_backend *sdl, const SDL_KeyboardEvent *key_event)
+{
+    uint16_t hotkey;
+    switch (key_event->keysym.sym)
+    {
+        case SDLK_BACKSPACE: hotkey = HOTKEY_REWIND; break;
+        case SDLK_TAB:       hotkey = HOTKEY_FAST_FORWARD; break;
+        case SDLK_F9:        hotkey = HOTKEY_DUMP_STATS; break;
+        default: return false;
+    }
+
+    if (key_event->type == SDL_KEYDOWN)
+        sdl->hotkeys_held |= hotkey;
+    else
+        sdl->hotkeys_held &= ~hotkey;
+
+    return true;
+}
+
+static void on_keypress(sdl_backend *sdl, const SDL_KeyboardEvent *key_event)
+{
+    bool key_pressed = key_event->type == SDL_KEYDOWN;
+
+    if (on_hotkey(sdl, key_event))
+        return;
+
+    uint32_t shift;
+    switch (key_event->keysym.sym)
+    {
+        case SDLK_w:      shift = BUTTON_UP; break;
+        case SDLK_a:      shift = BUTTON_LEFT; break;
+        case SDLK_s:      shift = BUTTON_DOWN; break;
+        case SDLK_d:      shift = BUTTON_RIGHT; break;
+        case SDLK_j:      shift = BUTTON_B; break;
+        case SDLK_k:      shift = BUTTON_A; break;
+        case SDLK_u:      shift = BUTTON_L; break;
+        case SDLK_i:      shift = BUTTON_R; break;
+        case SDLK_RETURN: shift = BUTTON_START; break;
+        case SDLK_SPACE:  shift = BUTTON_SELECT; break;
+        default: return;
+    }
+
+    uint16_t mask = 1 << shift;
+    sdl->buttons_held = (sdl->buttons_held & ~mask) | (key_pressed << shift);
+}
+
+/* Handle pending window and keyboard events, on the window's thread.
+ * Returns whether the window has to be redrawn.
+ */
+static bool handle_events(sdl_backend *sdl)
+{
+    bool redraw = false;
+
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        switch (event.type)
+        {
+            case SDL_QUIT:
+                atomic_store(&sdl->quit_requested, true);
+                break;
+
+            case SDL_KEYDOWN:
+            case SDL_KEYUP:
+                on_keypress(sdl, &event.key);
+                break;
+
+            // unchanged frames aren't presented, so the
+            // window has to be redrawn when it's uncovered
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_EXPOSED)
+                    redraw = true;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    atomic_store(&sdl->input, sdl->buttons_held | (unsigned)sdl->hotkeys_held << 16);
+    return redraw;
+}
+
+static int init_screen(sdl_backend *sdl)
+{
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+        goto error;
+
+    sdl->window = SDL_CreateWindow("CGBA -- A Game Boy Advance Emulator",
+                                   SDL_WINDOWPOS_UNDEFINED,
+                                   SDL_WINDOWPOS_UNDEFINED,
+                                   WINDOW_SCALE * FRAME_WIDTH,
+                                   WINDOW_SCALE * FRAME_HEIGHT,
+                                   SDL_WINDOW_OPENGL);
+
+    if (sdl->window == NULL)
+        goto error;
+
+    sdl->renderer = SDL_CreateRenderer(sdl->window, -1, 0);
+
+    if (sdl->renderer == NULL)
+        goto error;
+
+    sdl->screen = SDL_CreateTexture(sdl->renderer,
+                                    SDL_PIXELFORMAT_XRGB8888,
+                                    SDL_TEXTUREACCESS_STREAMING,
+                                    FRAME_WIDTH,
+                                    FRAME_HEIGHT);
+
+    if (sdl->screen == NULL)
+        goto error;
+
+    // white screen on startup, like the PPU's frame buffer
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(sdl->screen, NULL, &pixels, &pitch) < 0)
+        goto error;
+
+    memset(pixels, 0xff, FRAME_HEIGHT * pitch);
+    SDL_UnlockTexture(sdl->screen);
+    redraw_screen(sdl);
+
+    return 0;
+
+error:
+    fprintf(stderr, "Failed to initialize screen: %s\n", SDL_GetError());
+    return -1;
+}
+
+static void deinit_screen(sdl_backend *sdl)
+{
+    if (sdl->screen != NULL)
+        SDL_DestroyTexture(sdl->screen);
+
+    if (sdl->renderer != NULL)
+        SDL_DestroyRenderer(sdl->renderer);
+
+    if (sdl->window != NULL)
+        SDL_DestroyWindow(sdl->window);
+
+    SDL_Quit();
+}
+
+#ifdef PRESENTER_THREAD
+static void wake_presenter(sdl_backend *sdl)
+{
+    if (atomic_load(&sdl->presenter_sleeping))
+    {
+        pthread_mutex_lock(&sdl->lock);
+        pthread_cond_signal(&sdl->wake_presenter);
+        pthread_mutex_unlock(&sdl->lock);
+    }
+}
+
+/* Wait until there's a new frame, or until it's time to handle events
+ * again. Returns false once the thread should quit.
+ */
+static bool wait_for_frame(sdl_backend *sdl)
+{
+    for (int i = 0; i < SPIN_COUNT; ++i)
+    {
+        if (atomic_load(&sdl->middle) & SLOT_FRESH)
+            return true;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += EVENT_POLL_NS;
+    if (deadline.tv_nsec >= NS_PER_SEC)
+    {
+        deadline.tv_nsec -= NS_PER_SEC;
+        ++deadline.tv_sec;
+    }
+
+    pthread_mutex_lock(&sdl->lock);
+    atomic_store(&sdl->presenter_sleeping, true);
+    while (!(atomic_load(&sdl->middle) & SLOT_FRESH) && !atomic_load(&sdl->quit))
+    {
+        if (pthread_cond_timedwait(&sdl->wake_presenter, &sdl->lock, &deadline))
+            break; // timed out
+    }
+    atomic_store(&sdl->presenter_sleeping, false);
+    pthread_mutex_unlock(&sdl->lock);
+
+    return !atomic_load(&sdl->quit);
+}
+
+static void *presenter_main(void *arg)
+{
+    sdl_backend *sdl = arg;
+
+    // the window, renderer and events all belong to this thread
+    int result = init_screen(sdl);
+
+    pthread_mutex_lock(&sdl->lock);
+    sdl->start_result = result;
+    pthread_cond_signal(&sdl->started);
+    pthread_mutex_unlock(&sdl->lock);
+
+    if (result == 0)
+    {
+        while (wait_for_frame(sdl))
+            show_frame(sdl, handle_events(sdl));
+    }
+
+    deinit_screen(sdl);
+    return NULL;
+}
+
+static void stop_presenter(sdl_backend *sdl)
+{
+    atomic_store(&sdl->quit, true);
+    pthread_mutex_lock(&sdl->lock);
+    pthread_cond_signal(&sdl->wake_presenter);
+    pthread_mutex_unlock(&sdl->lock);
+    pthread_join(sdl->thread, NULL);
+}
+
+/* Start the presenting thread, and wait for it to set up the window */
+static int start_presenter(sdl_backend *sdl)
+{
+    sdl->start_result = 1; // still starting
+
+    if (pthread_create(&sdl->thread, NULL, presenter_main, sdl))
+        return -1;
+
+    pthread_mutex_lock(&sdl->lock);
+    while (sdl->start_result > 0)
+        pthread_cond_wait(&sdl->started, &sdl->lock);
+    pthread_mutex_unlock(&sdl->lock);
+
+    if (sdl->start_result < 0)
+    {
+        stop_presenter(sdl);
+        return -1;
+    }
+
+    return 0;
+}
+#else
+static int start_presenter(sdl_backend *sdl)
+{
+    if (init_screen(sdl))
+    {
+        deinit_screen(sdl);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void stop_presenter(sdl_backend *sdl)
+{
+    deinit_screen(sdl);
+}
+#endif /* PRESENTER_THREAD */
+
+static void sdl_present_frame(gba_backend *backend,
+                              const uint32_t *frame_buffer,
+                              const bool *line_changed)
+{
+    sdl_backend *sdl = (sdl_backend *)backend;
+    frame_slot *slot = &sdl->slots[sdl->back];
+
+    ++sdl->frame_no;
+    for (int y = 0; y < FRAME_HEIGHT; ++y)
+    {
+        if (line_changed[y])
+            sdl->line_updated[y] = sdl->frame_no;
+    }
+
+    memcpy(slot->pixels, frame_buffer, sizeof slot->pixels);
+    memcpy(slot->line_updated, sdl->line_updated, sizeof slot->line_updated);
+    slot->frame_no = sdl->frame_no;
+
+    sdl->back = atomic_exchange(&sdl->middle, sdl->back | SLOT_FRESH) & SLOT_MASK;
+
+#ifdef PRESENTER_THREAD
+    wake_presenter(sdl);
+#else
+    show_frame(sdl, false);
+#endif
+}
+
+static bool sdl_poll_input(gba_backend *backend, uint16_t *buttons_held, uint16_t *hotkeys_held)
+{
+    sdl_backend *sdl = (sdl_backend *)backend;
+
+#ifndef PRESENTER_THREAD
+    if (handle_events(sdl))
+        redraw_screen(sdl);
+#endif
+
+    unsigned input = atomic_load(&sdl->input);
+    *buttons_held = input & 0xffff;
+    *hotkeys_held = input >> 16;
+    return !atomic_load(&sdl->quit_requested);
+}
+
+static void sdl_destroy(gba_backend *backend)
+{
+    sdl_backend *sdl = (sdl_backend *)backend;
+
+    stop_presenter(sdl);
+    pthread_cond_destroy(&sdl->started);
+    pthread_cond_destroy(&sdl->wake_presenter);
+    pthread_mutex_destroy(&sdl->lock);
+    free(sdl);
+}
+
+gba_backend *create_sdl_backend(void)
+{
+    sdl_backend *sdl = malloc(sizeof(sdl_backend));
+    if (sdl == NULL)
+        return NULL;
+
+    memset(sdl, 0, sizeof(sdl_backend));
+    sdl->backend.present_frame = sdl_present_frame;
+    sdl->backend.poll_input = sdl_poll_input;
+    sdl->backend.destroy = sdl_destroy;
+
+    atomic_init(&sdl->presenter_sleeping, false);
+    atomic_init(&sdl->quit, false);
+    atomic_init(&sdl->input, 0);
+    atomic_init(&sdl->quit_requested, false);
+    atomic_init(&sdl->middle, 1);
+    sdl->back = 0;
+    sdl->front = 2;
+
+    if (pthread_mutex_init(&sdl->lock, NULL))
+        goto mutex_error;
+
+    if (pthread_cond_init(&sdl->wake_presenter, NULL))
+        goto wake_presenter_error;
+
+    if (pthread_cond_init(&sdl->started, NULL))
+        goto started_error;
+
+    if (start_presenter(sdl))
+        goto presenter_error;
+
+    return &sdl->backend;
+
+presenter_error:
+    pthread_cond_destroy(&sdl->started);
+started_error:
+    pthread_cond_destroy(&sdl->wake_presenter);
+wake_presenter_error:
+    pthread_mutex_destroy(&sdl->lock);
+mutex_error:
+    free(sdl);
+    return NULL;
+}
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include "cgba/bios.h"
 #include "cgba/cpu.h"
+#include "cgba/error.h"
 #include "cgba/memory.h"
 #include "cpu/arm7tdmi.h"
 
@@ -64,8 +65,7 @@ int gba_syscall(arm7tdmi *cpu)
         }
 
         default:
-            fprintf(stderr, "Error: unimplemented syscall: %02X\n", callno);
-            exit(1);
+            fatal_error("Error: unimplemented syscall: %02X\n", callno);
     }
 
     // MOVS PC, R14_svc to exit the SWI trap
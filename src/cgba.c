@@ -0,0 +1,169 @@
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/backend.h"
+#include "cgba/cgba.h"
+#include "cgba/error.h"
+#include "cgba/gamepad.h"
+#include "cgba/gba.h"
+#include "cgba/memory.h"
+#include "cgba/rom.h"
+#include "cgba/savestate.h"
+
+#define MAX_ERROR_MESSAGE_LEN 256
+
+struct cgba {
+    gba_system system;
+    bool rom_loaded;
+    bool failed;
+    char error_message[MAX_ERROR_MESSAGE_LEN];
+};
+
+cgba *cgba_create(void)
+{
+    cgba *gba = malloc(sizeof(cgba));
+    if (gba == NULL)
+        return NULL;
+
+    gba_backend *backend = create_headless_backend();
+    if (backend == NULL)
+        goto backend_error;
+
+    if (init_system(&gba->system, backend))
+        goto system_error;
+
+    gba->rom_loaded = false;
+    gba->failed = false;
+    gba->error_message[0] = '\0';
+
+    return gba;
+
+system_error:
+    backend->destroy(backend);
+backend_error:
+    free(gba);
+    return NULL;
+}
+
+void cgba_destroy(cgba *gba)
+{
+    if (gba == NULL)
+        return;
+
+    deinit_system(&gba->system);
+    free(gba);
+}
+
+cgba_status cgba_load_rom(cgba *gba, const void *rom, size_t size)
+{
+    cgba_rom *shared = cgba_rom_create(rom, size);
+    if (shared == NULL)
+        return size > GBA_ROM_SIZE ? CGBA_ERR_ROM_TOO_LARGE : CGBA_ERR_NO_MEMORY;
+
+    cgba_status status = cgba_insert_rom(gba, shared);
+    cgba_rom_release(shared);
+    return status;
+}
+
+// the public handle is the ROM image itself
+cgba_rom *cgba_rom_create(const void *rom, size_t size)
+{
+    return (cgba_rom *)create_rom_image(rom, size);
+}
+
+void cgba_rom_release(cgba_rom *rom)
+{
+    release_rom_image((gba_rom *)rom);
+}
+
+cgba_status cgba_insert_rom(cgba *gba, cgba_rom *rom)
+{
+    if (gba->rom_loaded)
+        return CGBA_ERR_ROM_LOADED;
+
+    insert_rom_image(gba->system.mem, (gba_rom *)rom);
+
+    // resetting fills the CPU's pipeline from the game
+    jmp_buf handler;
+    if (setjmp(handler))
+        goto emulation_error;
+
+    set_fatal_error_handler(&handler);
+    reset_system(&gba->system);
+    set_fatal_error_handler(NULL);
+
+    gba->rom_loaded = true;
+    return CGBA_OK;
+
+emulation_error:
+    set_fatal_error_handler(NULL);
+    snprintf(gba->error_message, sizeof gba->error_message, "%s", fatal_error_message());
+    gba->failed = true;
+    return CGBA_ERR_EMULATION;
+}
+
+cgba_status cgba_step_frame(cgba *gba, uint16_t buttons_held, const uint32_t **frame)
+{
+    if (gba->failed)
+        return CGBA_ERR_EMULATION;
+
+    if (!gba->rom_loaded)
+        return CGBA_ERR_NO_ROM;
+
+    update_gamepad(gba->system.gamepad, buttons_held);
+
+    // errors deep in emulation come back here instead of exiting
+    jmp_buf handler;
+    if (setjmp(handler))
+        goto emulation_error;
+
+    set_fatal_error_handler(&handler);
+    run_frame(&gba->system);
+    set_fatal_error_handler(NULL);
+
+    *frame = gba->system.ppu->frame_buffer;
+    return CGBA_OK;
+
+emulation_error:
+    set_fatal_error_handler(NULL);
+    snprintf(gba->error_message, sizeof gba->error_message, "%s", fatal_error_message());
+    gba->failed = true;
+    return CGBA_ERR_EMULATION;
+}
+
+const char *cgba_error_message(const cgba *gba)
+{
+    return gba->error_message;
+}
+
+size_t cgba_state_size(void)
+{
+    return savestate_size();
+}
+
+cgba_status cgba_save_state(const cgba *gba, void *buf, size_t size)
+{
+    if (!gba->rom_loaded)
+        return CGBA_ERR_NO_ROM;
+
+    if (size < savestate_size())
+        return CGBA_ERR_BUFFER_SIZE;
+
+    save_state(&gba->system, buf);
+    return CGBA_OK;
+}
+
+cgba_status cgba_load_state(cgba *gba, const void *buf, size_t size)
+{
+    if (!gba->rom_loaded)
+        return CGBA_ERR_NO_ROM;
+
+    if (load_state(&gba->system, buf, size))
+        return CGBA_ERR_BAD_STATE;
+
+    gba->failed = false;
+    gba->error_message[0] = '\0';
+    return CGBA_OK;
+}
@@ -4,7 +4,9 @@
 #include <stdlib.h>
 #include "arm7tdmi.h"
 #include "cgba/cpu.h"
+#include "cgba/error.h"
 #include "cgba/memory.h"
+#include "cgba/stats.h"
 
 static void restore_cpsr(arm7tdmi *cpu)
 {
@@ -15,15 +17,17 @@ static void restore_cpsr(arm7tdmi *cpu)
 
 static void undefined_instruction_trap(arm7tdmi *cpu)
 {
-    fprintf(stderr,
-            "Error: ARM undefined instruction trap encountered %08X at address %08X\n",
-            cpu->pipeline[0],
-            cpu->registers[R15] - 8);
-    exit(1);
+    COUNT_STAT(STAT_ARM_UNDEFINED);
+
+    fatal_error("Error: ARM undefined instruction trap encountered %08X at address %08X\n",
+                cpu->pipeline[0],
+                cpu->registers[R15] - 8);
 }
 
 static int bx(arm7tdmi *cpu, uint32_t inst)
 {
+    COUNT_STAT(STAT_ARM_BX);
+
     int rn = inst & 0xf;
     uint32_t addr = read_register(cpu, rn);
 
@@ -35,6 +39,8 @@ static int bx(arm7tdmi *cpu, uint32_t inst)
 
 static int branch(arm7tdmi *cpu, uint32_t inst)
 {
+    COUNT_STAT(STAT_ARM_BRANCH);
+
     // instruction contains signed 2's complement 24-bit offset
     uint32_t offset = inst & 0x00ffffff;
 
@@ -59,6 +65,8 @@ static int branch(arm7tdmi *cpu, uint32_t inst)
 
 static int process_data(arm7tdmi *cpu, uint32_t inst)
 {
+    COUNT_STAT(STAT_ARM_PROCESS_DATA);
+
     int num_clocks;
     bool set_conds = inst & (1 << 20);
     uint8_t opcode = (inst >> 21) & 0xf;
@@ -239,6 +247,8 @@ static int process_data(arm7tdmi *cpu, uint32_t inst)
 
 static int block_data_transfer(arm7tdmi *cpu, uint32_t inst)
 {
+    COUNT_STAT(STAT_ARM_BLOCK_DATA_TRANSFER);
+
     block_transfer_args transfer_args = {
         .preindex          = inst & (1 << 24),
         .add               = inst & (1 << 23),
@@ -254,6 +264,8 @@ static int block_data_transfer(arm7tdmi *cpu, uint32_t inst)
 
 static int single_data_transfer(arm7tdmi *cpu, uint32_t inst)
 {
+    COUNT_STAT(STAT_ARM_SINGLE_DATA_TRANSFER);
+
     int num_clocks;
     bool immediate = !(inst & (1 << 25));
     bool preindex = inst & (1 << 24);
@@ -351,6 +363,8 @@ static int single_data_transfer(arm7tdmi *cpu, uint32_t inst)
 
 static int halfword_transfer(arm7tdmi *cpu, uint32_t inst, bool immediate)
 {
+    COUNT_STAT(STAT_ARM_HALFWORD_TRANSFER);
+
     int num_clocks;
     bool preindex = inst & (1 << 24);
     bool add_offset = inst & (1 << 23);
@@ -447,6 +461,8 @@ static int halfword_transfer(arm7tdmi *cpu, uint32_t inst, bool immediate)
 // transfer data from a PSR to a register
 static int mrs_transfer(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_ARM_MRS_TRANSFER);
+
     uint32_t inst = cpu->pipeline[0];
     bool from_spsr = inst & (1 << 22);
     int rd = (inst >> 12) & 0xf;
@@ -455,8 +471,7 @@ static int mrs_transfer(arm7tdmi *cpu)
 
     if (bank_mode == BANK_NONE && from_spsr)
     {
-        fprintf(stderr, "Error: PSR transfer from SPSR attempted in user mode\n");
-        exit(1);
+        fatal_error("Error: PSR transfer from SPSR attempted in user mode\n");
     }
 
     write_register(cpu, rd, src_psr);
@@ -469,6 +484,8 @@ static int mrs_transfer(arm7tdmi *cpu)
 // transfer data from a register or immediate value to a PSR
 static int msr_transfer(arm7tdmi *cpu, uint32_t inst)
 {
+    COUNT_STAT(STAT_ARM_MSR_TRANSFER);
+
     bool to_spsr = inst & (1 << 22);
     bool set_cntrl_bits = inst & (1 << 16);
     bool set_flag_bits = inst & (1 << 19);
@@ -480,8 +497,7 @@ static int msr_transfer(arm7tdmi *cpu, uint32_t inst)
 
     if (to_spsr && (cpu_mode == MODE_USR || cpu_mode == MODE_SYS))
     {
-        fprintf(stderr, "Error: PSR transfer to SPSR attempted in user mode\n");
-        exit(1);
+        fatal_error("Error: PSR transfer to SPSR attempted in user mode\n");
     }
 
     uint32_t new_psr;
@@ -517,6 +533,8 @@ static int msr_transfer(arm7tdmi *cpu, uint32_t inst)
 
 static int multiply(arm7tdmi *cpu, uint32_t inst)
 {
+    COUNT_STAT(STAT_ARM_MULTIPLY);
+
     bool mul_long   = (inst >> 23) & 1;
     bool signed_    = (inst >> 22) & 1; // always zero for MUL/MLA
     bool accumulate = (inst >> 21) & 1;
@@ -591,6 +609,8 @@ static int multiply(arm7tdmi *cpu, uint32_t inst)
 
 static int single_data_swap(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_ARM_SINGLE_DATA_SWAP);
+
     uint32_t inst = cpu->pipeline[0];
     bool byte = inst & (1 << 22);
     int rn = (inst >> 16) & 0xf;
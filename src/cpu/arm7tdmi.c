@@ -5,9 +5,11 @@
 #include "arm7tdmi.h"
 #include "cgba/bios.h"
 #include "cgba/cpu.h"
+#include "cgba/error.h"
 #include "cgba/interrupt.h"
 #include "cgba/log.h"
 #include "cgba/memory.h"
+#include "cgba/stats.h"
 
 // For use by the LDM/STM instructions
 static int count_set_bits(uint32_t n)
@@ -42,6 +44,8 @@ void prefetch(arm7tdmi *cpu)
 /* Reload the instruction pipeline after a pipeline flush */
 void reload_pipeline(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_PIPELINE_RELOADS);
+
     prefetch(cpu);
     prefetch(cpu);
 }
@@ -110,6 +114,7 @@ bool check_cond(arm7tdmi *cpu)
         case 0xf: result = false; break;
     }
 
+    COUNT_STAT(result ? STAT_COND_PASSED : STAT_COND_FAILED);
     return result;
 }
 
@@ -283,6 +288,8 @@ bool barrel_shift(arm7tdmi *cpu, barrel_shift_args *args, uint32_t *result)
  */
 int software_interrupt(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_SOFTWARE_INTERRUPT);
+
     int num_clocks = 3; // 2S + 1N
     int prefetch_offset = cpu->cpsr & T_BITMASK ? 2 : 4;
 
@@ -387,8 +394,7 @@ int do_block_transfer(arm7tdmi *cpu, block_transfer_args *args)
             arm_bankmode mode = get_current_bankmode(cpu);
             if (mode == BANK_NONE)
             {
-                fprintf(stderr, "Error: attempted LDM mode change in user mode\n");
-                exit(1);
+                fatal_error("Error: attempted LDM mode change in user mode\n");
             }
 
             cpu->cpsr = cpu->spsr[mode];
@@ -478,10 +484,8 @@ arm_bankmode get_current_bankmode(arm7tdmi *cpu)
         case MODE_UND: mode = BANK_UND; break;
 
         default: // illegal mode, should not get here
-            fprintf(stderr,
-                    "Error: Illegal CPU mode encountered: %02x\n",
-                    cpu->cpsr & CPU_MODE_MASK);
-            exit(1);
+            fatal_error("Error: Illegal CPU mode encountered: %02x\n",
+                        cpu->cpsr & CPU_MODE_MASK);
     }
 
     return mode;
@@ -491,8 +495,7 @@ static void validate_register_number_or_die(int regno)
 {
     if (regno > R15 || regno < R0)
     {
-        fprintf(stderr, "Illegal register number accessed: %d\n", regno);
-        exit(1);
+        fatal_error("Illegal register number accessed: %d\n", regno);
     }
 }
 
@@ -547,13 +550,11 @@ void panic_illegal_instruction(arm7tdmi *cpu)
         addr = cpu->registers[R15] - 8;
     }
 
-    fprintf(stderr,
-            "Error: Illegal %s instruction encountered: %0*X at address %08X\n",
-            inst_type,
-            padlen,
-            inst,
-            addr);
-    exit(1);
+    fatal_error("Error: Illegal %s instruction encountered: %0*X at address %08X\n",
+                inst_type,
+                padlen,
+                inst,
+                addr);
 }
 
 int run_cpu(arm7tdmi *cpu)
@@ -568,6 +569,7 @@ int run_cpu(arm7tdmi *cpu)
         fputs("Servicing IRQ\n", stderr);
 #endif
         handle_interrupt(cpu);
+        COUNT_STAT(STAT_IRQ_ENTRIES);
         return 1;
     }
 
@@ -5,6 +5,7 @@
 #include "arm7tdmi.h"
 #include "cgba/cpu.h"
 #include "cgba/memory.h"
+#include "cgba/stats.h"
 
 static int do_branch(arm7tdmi *cpu, uint32_t offset)
 {
@@ -17,6 +18,8 @@ static int do_branch(arm7tdmi *cpu, uint32_t offset)
 
 static int unconditional_branch(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_UNCONDITIONAL_BRANCH);
+
     uint16_t inst = cpu->pipeline[0];
     // sign-extended 12-bit offset
     uint32_t offset = inst & 0x7ff;
@@ -30,6 +33,8 @@ static int unconditional_branch(arm7tdmi *cpu)
 
 static int conditional_branch(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_CONDITIONAL_BRANCH);
+
     if (!check_cond(cpu))
     {
         prefetch(cpu);
@@ -49,6 +54,8 @@ static int conditional_branch(arm7tdmi *cpu)
 
 static int multiple_load_store(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_MULTIPLE_LOAD_STORE);
+
     uint16_t inst = cpu->pipeline[0];
     bool load = inst & (1 << 11);
     int register_list = inst & 0xff;
@@ -69,6 +76,8 @@ static int multiple_load_store(arm7tdmi *cpu)
 
 static int long_branch_with_link(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_LONG_BRANCH_WITH_LINK);
+
     uint16_t inst = cpu->pipeline[0];
     bool offset_low = (inst >> 11) & 1;
 
@@ -98,6 +107,8 @@ static int long_branch_with_link(arm7tdmi *cpu)
 
 static int add_offset_to_sp(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_ADD_OFFSET_TO_SP);
+
     uint16_t inst = cpu->pipeline[0];
     bool negative = (inst >> 7) & 1;
     uint32_t offset = (inst & 0x7f) << 2;
@@ -116,6 +127,8 @@ static int add_offset_to_sp(arm7tdmi *cpu)
 
 static int operate_with_immediate(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_OPERATE_WITH_IMMEDIATE);
+
     uint16_t inst = cpu->pipeline[0];
     int operation = (inst >> 11) & 0x3;
     int rd = (inst >> 8) & 0x7;
@@ -177,6 +190,8 @@ static int operate_with_immediate(arm7tdmi *cpu)
 
 static int hi_register_op_or_bx(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_HI_REGISTER_OP_OR_BX);
+
     uint16_t inst = cpu->pipeline[0];
     int op = (inst >> 8) & 0x3;
     bool h1 = (inst >> 7) & 1;
@@ -253,6 +268,8 @@ static int hi_register_op_or_bx(arm7tdmi *cpu)
 
 static int push_pop_registers(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_PUSH_POP_REGISTERS);
+
     uint16_t inst = cpu->pipeline[0];
     bool link = inst & (1 << 8);
     bool load = inst & (1 << 11);
@@ -282,6 +299,8 @@ static int push_pop_registers(arm7tdmi *cpu)
 
 static int load_store_halfword(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_LOAD_STORE_HALFWORD);
+
     uint16_t inst = cpu->pipeline[0];
     bool load = inst & (1 << 11);
     uint32_t offset = ((inst >> 6) & 0x1f) << 1;
@@ -312,6 +331,8 @@ static int load_store_halfword(arm7tdmi *cpu)
 
 static int sp_relative_load_store(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_SP_RELATIVE_LOAD_STORE);
+
     uint16_t inst = cpu->pipeline[0];
     bool load = inst & (1 << 11);
     int rd = (inst >> 8) & 0x7;
@@ -342,6 +363,8 @@ static int sp_relative_load_store(arm7tdmi *cpu)
 
 static int load_address(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_LOAD_ADDRESS);
+
     uint16_t inst = cpu->pipeline[0];
     bool sp = (inst >> 11) & 1;
     int rd = (inst >> 8) & 0x7;
@@ -362,6 +385,8 @@ static int load_address(arm7tdmi *cpu)
 
 static int load_store_with_offset(arm7tdmi *cpu, bool immediate)
 {
+    COUNT_STAT(STAT_THUMB_LOAD_STORE_WITH_OFFSET);
+
     uint16_t inst = cpu->pipeline[0];
     bool load = inst & (1 << 11);
 
@@ -431,6 +456,8 @@ static int load_store_with_offset(arm7tdmi *cpu, bool immediate)
 
 static int load_store_sign_extended(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_LOAD_STORE_SIGN_EXTENDED);
+
     uint16_t inst = cpu->pipeline[0];
     int opcode = (inst >> 10) & 0x3;
     int ro = (inst >> 6) & 0x7;
@@ -495,6 +522,8 @@ static int load_store_sign_extended(arm7tdmi *cpu)
 
 static int pc_relative_load(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_PC_RELATIVE_LOAD);
+
     uint16_t inst = cpu->pipeline[0];
     uint32_t imm = (inst & 0xff) << 2; // 10-bit immediate
     int rd = (inst >> 8) & 0x7;
@@ -522,6 +551,8 @@ static int pc_relative_load(arm7tdmi *cpu)
 
 static int alu_operation(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_ALU_OPERATION);
+
     uint32_t inst = cpu->pipeline[0];
     int opcode = (inst >> 6) & 0xf;
     int rs = (inst >> 3) & 0x7;
@@ -669,6 +700,8 @@ static int alu_operation(arm7tdmi *cpu)
 
 static int add_subtract(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_ADD_SUBTRACT);
+
     uint16_t inst = cpu->pipeline[0];
     bool immediate = inst & (1 << 10);
     bool sub = inst & (1 << 9);
@@ -713,6 +746,8 @@ static int add_subtract(arm7tdmi *cpu)
 
 static int move_shifted_register(arm7tdmi *cpu)
 {
+    COUNT_STAT(STAT_THUMB_MOVE_SHIFTED_REGISTER);
+
     uint16_t inst = cpu->pipeline[0];
     uint32_t rdval;
 
@@ -0,0 +1,45 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/error.h"
+
+#define MAX_ERROR_MESSAGE_LEN 256
+
+// per thread, so that separate instances can run on separate threads
+static _Thread_local jmp_buf *error_handler;
+static _Thread_local char error_message[MAX_ERROR_MESSAGE_LEN];
+
+noreturn void fatal_error(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    if (error_handler == NULL)
+    {
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        exit(1);
+    }
+
+    vsnprintf(error_message, sizeof error_message, fmt, args);
+    va_end(args);
+
+    // messages are written to be printed on their own line
+    size_t len = strlen(error_message);
+    if (len && error_message[len - 1] == '\n')
+        error_message[len - 1] = '\0';
+
+    longjmp(*error_handler, 1);
+}
+
+void set_fatal_error_handler(jmp_buf *handler)
+{
+    error_handler = handler;
+}
+
+const char *fatal_error_message(void)
+{
+    return error_message;
+}
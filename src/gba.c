@@ -1,14 +1,33 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include "cgba/backend.h"
+#include "cgba/bios.h"
 #include "cgba/cpu.h"
 #include "cgba/gamepad.h"
 #include "cgba/gba.h"
 #include "cgba/memory.h"
+#include "cgba/movie.h"
 #include "cgba/ppu.h"
-#include "SDL_events.h"
-#include "SDL_timer.h"
+#include "cgba/profiler.h"
+#include "cgba/rewind.h"
+#include "cgba/savestate.h"
+#include "cgba/stats.h"
+
+/* frames that automatic frameskip can skip in a row,
+ * so that the screen keeps updating however slow the host
+ */
+#define MAX_AUTO_FRAMESKIP 4
+
+/* the GBA's own frame period, which is as often as automatic
+ * frameskip draws frames while running unthrottled
+ */
+#define GBA_FRAME_NS ((uint64_t)GBA_CYCLES_PER_FRAME * 1000000000 / GBA_CPU_FREQ)
 
 static void connect_compoments(gba_system *gba)
 {
@@ -18,114 +37,292 @@ static void connect_compoments(gba_system *gba)
 
     gba->mem->ppu = gba->ppu;
     gba->ppu->mem = gba->mem;
+    gba->ppu->vram = gba->mem->vram;
+    gba->ppu->palette_ram = gba->mem->palette_ram;
+    gba->ppu->oam = gba->mem->oam;
 
     gba->gamepad->mem = gba->mem;
     gba->mem->gamepad = gba->gamepad;
+
+    gba->ppu->backend = gba->backend;
 }
 
-void init_system_or_die(gba_system *gba, const char *romfile, const char* biosfile)
+int init_system(gba_system *gba, gba_backend *backend)
 {
     gba->skip_bios = true; // hardcoded until enough of system is implemented
     gba->running = true;
+    gba->backend = backend;
+    gba->rewind = NULL;
+    gba->recording = NULL;
+    gba->playback = NULL;
+    gba->statsfile = NULL;
+    gba->profiler = NULL;
+    gba->hotkeys_held = 0;
     gba->clocks_emulated = 0;
-    gba->next_frame_time = GBA_FRAME_DURATION_MS;
-    gba->mem = init_memory(romfile, biosfile);
+    gba->instructions_emulated = 0;
+    gba->speed = 1;
+    gba->fast_forwarding = false;
+    init_frame_pacer(&gba->pacer, gba->speed, false);
+    gba->frameskip = 0;
+    gba->frames_skipped = 0;
+    gba->frame_drawn_ns = 0;
+    gba->run_ahead = 0;
+    gba->run_ahead_state = NULL;
+    gba->run_ahead_frames = 0;
+    gba->run_ahead_ns = 0;
+    gba->base_frame_ns = 0;
+
+    gba->mem = init_memory();
     if (gba->mem == NULL)
-    {
-        fputs("Failed to allocate GBA memory\n", stderr);
-        exit(1);
-    }
+        goto mem_error;
 
     gba->cpu = init_cpu();
     if (gba->cpu == NULL)
-    {
-        fputs("Failed to allocate ARM7TDMI\n", stderr);
-        exit(1);
-    }
+        goto cpu_error;
 
     gba->ppu = init_ppu();
     if (gba->ppu == NULL)
-    {
-        fputs("Failed to allocate PPU\n", stderr);
-        exit(1);
-    }
+        goto ppu_error;
 
     gba->gamepad = init_gamepad();
     if (!gba->gamepad)
-    {
-        fputs("Failed to allocate gamepad\n", stderr);
-        exit(1);
-    }
+        goto gamepad_error;
 
     connect_compoments(gba);
 
+    return 0;
+
+gamepad_error:
+    deinit_ppu(gba->ppu);
+ppu_error:
+    deinit_cpu(gba->cpu);
+cpu_error:
+    deinit_memory(gba->mem);
+mem_error:
+    return -1;
+}
+
+void reset_system(gba_system *gba)
+{
     reset_cpu(gba->cpu);
 
     if (gba->skip_bios)
         skip_boot_screen(gba->cpu);
+}
+
+void init_system_or_die(gba_system *gba,
+                        const char *romfile,
+                        const char *biosfile,
+                        gba_backend *backend)
+{
+    if (init_system(gba, backend))
+    {
+        fputs("Failed to allocate GBA system\n", stderr);
+        exit(1);
+    }
+
+    if (load_rom_file(gba->mem, romfile))
+        exit(1);
 
-    init_screen_or_die(gba->ppu);
+    if (biosfile != NULL && load_bios_file(gba->mem, biosfile))
+        exit(1);
+
+    gba->mem->has_bios = biosfile != NULL;
+
+    reset_system(gba);
 }
 
 void deinit_system(gba_system *gba)
 {
+    destroy_rewind_buffer(gba->rewind);
+    close_movie(gba->recording);
+    close_movie(gba->playback);
+    destroy_profiler(gba->profiler);
+    free(gba->run_ahead_state);
     deinit_memory(gba->mem);
     deinit_cpu(gba->cpu);
     deinit_ppu(gba->ppu);
     deinit_gamepad(gba->gamepad);
+    gba->backend->destroy(gba->backend);
 }
 
 static void poll_input(gba_system *gba)
 {
-    SDL_Event event;
-    while (SDL_PollEvent(&event))
+    uint16_t buttons_held;
+    uint16_t hotkeys_before = gba->hotkeys_held;
+    if (!gba->backend->poll_input(gba->backend, &buttons_held, &gba->hotkeys_held))
+        gba->running = false;
+
+    if (gba->playback != NULL && !play_movie_frame(gba->playback, &buttons_held))
+        gba->running = false;
+
+    if (gba->recording != NULL)
+        record_movie_frame(gba->recording, buttons_held);
+
+    bool dump_pressed = gba->hotkeys_held & ~hotkeys_before & HOTKEY_DUMP_STATS;
+    if (dump_pressed && gba->statsfile != NULL && !dump_stats(gba->statsfile))
+        printf("Wrote stats to %s\n", gba->statsfile);
+
+    update_gamepad(gba->gamepad, buttons_held);
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Run unthrottled while fast forward is held */
+static void update_speed(gba_system *gba)
+{
+    bool fast_forward = gba->hotkeys_held & HOTKEY_FAST_FORWARD;
+    if (fast_forward == gba->fast_forwarding)
+        return;
+
+    gba->fast_forwarding = fast_forward;
+    set_pacer_speed(&gba->pacer, fast_forward ? 0 : gba->speed);
+}
+
+/* Decide whether the next frame is drawn. Skipped frames are still
+ * emulated in full, so only the pixel work and presenting are saved.
+ */
+static void update_frameskip(gba_system *gba, bool behind)
+{
+    uint64_t now = monotonic_ns();
+    bool skip;
+
+    if (gba->frameskip != FRAMESKIP_AUTO)
+        skip = gba->frames_skipped < gba->frameskip;
+    else if (gba->pacer.frame_ns == 0)
+        // Unthrottled, there's no schedule to fall behind, but frames
+        // drawn faster than the GBA would draw them are mostly never seen
+        skip = now - gba->frame_drawn_ns < GBA_FRAME_NS;
+    else
+        skip = behind && gba->frames_skipped < MAX_AUTO_FRAMESKIP;
+
+    if (!skip)
+        gba->frame_drawn_ns = now;
+
+    gba->frames_skipped = skip ? gba->frames_skipped + 1 : 0;
+    gba->ppu->skip_frame = skip;
+}
+
+/* While rewind is held, each frame starts from an older snapshot */
+static void update_rewind(gba_system *gba)
+{
+    if (gba->rewind == NULL)
+        return;
+
+    if (gba->hotkeys_held & HOTKEY_REWIND)
+        rewind_step_back(gba->rewind, gba);
+    else
+        record_rewind_frame(gba->rewind, gba);
+}
+
+void run_frame(gba_system *gba)
+{
+    while (!gba->ppu->frame_presented_signal)
     {
-        switch (event.type)
-        {
-            case SDL_QUIT:
-                gba->running = false;
-                break;
-
-            case SDL_KEYDOWN:
-            case SDL_KEYUP:
-                on_keypress(gba->gamepad, &event.key);
-                break;
-
-            default:
-                break;
-        }
+        int num_clocks = run_cpu(gba->cpu);
+        gba->clocks_emulated += num_clocks;
+        ++gba->instructions_emulated;
+        if (gba->profiler != NULL)
+            profile_cycles(gba->profiler, gba->cpu, num_clocks);
+
+        run_ppu(gba->ppu, num_clocks);
     }
+
+    gba->ppu->frame_presented_signal = false;
 }
 
-static void throttle_emulation(gba_system *gba)
+int enable_run_ahead(gba_system *gba, int frames)
 {
-    uint64_t curr_time = SDL_GetTicks64();
-    if (curr_time < gba->next_frame_time)
-        SDL_Delay(gba->next_frame_time - curr_time);
+    if (gba->run_ahead_state == NULL)
+    {
+        gba->run_ahead_state = malloc(savestate_size());
+        if (gba->run_ahead_state == NULL)
+            return -1;
+    }
+
+    gba->run_ahead = frames;
+    return 0;
+}
+
+/* Emulate a frame without showing it, then show the frame run_ahead
+ * frames on from there with the buttons held now, and go back. Only
+ * the last frame run ahead is drawn. The frames run ahead are undone,
+ * so they're left out of the instruction count, profile and stats.
+ */
+static void run_frame_ahead(gba_system *gba)
+{
+    bool skip = gba->ppu->skip_frame;
+    uint64_t start = monotonic_ns();
+
+    gba->ppu->skip_frame = true;
+    run_frame(gba);
+
+    uint64_t ahead_start = monotonic_ns();
+    save_state(gba, gba->run_ahead_state);
+
+    uint64_t instructions_emulated = gba->instructions_emulated;
+    gba_profiler *profiler = gba->profiler;
+    emulation_stats stats;
+    save_stats(&stats);
+    gba->profiler = NULL;
+
+    for (int i = 1; i <= gba->run_ahead; ++i)
+    {
+        gba->ppu->skip_frame = skip || i < gba->run_ahead;
+        run_frame(gba);
+    }
+
+    load_state(gba, gba->run_ahead_state, savestate_size());
+    gba->ppu->skip_frame = skip;
+    gba->instructions_emulated = instructions_emulated;
+    gba->profiler = profiler;
+    restore_stats(&stats);
 
-    gba->next_frame_time = SDL_GetTicks64() + GBA_FRAME_DURATION_MS;
+    uint64_t end = monotonic_ns();
+    gba->base_frame_ns += ahead_start - start;
+    gba->run_ahead_ns += end - ahead_start;
+    ++gba->run_ahead_frames;
 }
 
 void run_system(gba_system *gba)
 {
-    // emulate one second until we implement a basic PPU
-    int num_clocks;
     while (gba->running)
     {
-        num_clocks = run_cpu(gba->cpu);
-        gba->clocks_emulated += num_clocks;
-        run_ppu(gba->ppu, num_clocks);
+        if (gba->run_ahead)
+            run_frame_ahead(gba);
+        else
+            run_frame(gba);
 
-        if (gba->ppu->frame_presented_signal)
-        {
-            gba->ppu->frame_presented_signal = false;
-            poll_input(gba);
-            throttle_emulation(gba);
-        }
+        poll_input(gba);
+        update_rewind(gba);
+        update_speed(gba);
+        update_frameskip(gba, wait_for_next_frame(&gba->pacer));
     }
 }
 
-void report_rom_info(uint8_t *rom)
+void report_run_ahead_cost(const gba_system *gba)
+{
+    if (gba->run_ahead_frames == 0)
+        return;
+
+    double base_ms = gba->base_frame_ns / 1e6 / gba->run_ahead_frames;
+    double ahead_ms = gba->run_ahead_ns / 1e6 / gba->run_ahead_frames;
+
+    printf("Running %d frame%s ahead took %.3f ms per frame on top of %.3f ms "
+           "to emulate the frame itself (%.1fx)\n",
+           gba->run_ahead,
+           gba->run_ahead == 1 ? "" : "s",
+           ahead_ms,
+           base_ms,
+           (base_ms + ahead_ms) / base_ms);
+}
+
+void report_rom_info(const uint8_t *rom)
 {
     char title[13] = {0};
     char game_and_maker_code[7] = {0};
@@ -1,5 +1,8 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cgba/error.h"
 #include "cgba/gamepad.h"
 #include "cgba/io.h"
 #include "cgba/memory.h"
@@ -31,10 +34,8 @@ static inline void write_bg_scroll_register(gba_mem *mem,
             break;
 
         default:
-            fprintf(stderr,
-                    "Error: BG scroll register helper invalid register: %08x\n",
-                    regname);
-            exit(1);
+            fatal_error("Error: BG scroll register helper invalid register: %08x\n",
+                        regname);
     }
 
     if (msb)
@@ -43,10 +44,96 @@ static inline void write_bg_scroll_register(gba_mem *mem,
         *reg = (*reg & 0x300) | byte;
 }
 
+static inline void write_bg_reference_point(gba_mem *mem, uint32_t addr, uint8_t byte)
+{
+    // BG2X, BG2Y, BG3X, BG3Y are four consecutive 28-bit registers
+    int affno = (addr - BG2X_L) / 0x10;
+    bool y = (addr - BG2X_L) & 0x4;
+    int shift = 8 * (addr & 0x3);
+
+    uint32_t *reg = y ? mem->ppu->bgy + affno : mem->ppu->bgx + affno;
+    *reg = ((*reg & ~(0xffu << shift)) | (uint32_t)byte << shift) & 0x0fffffff;
+
+    if (y)
+        reload_bg_reference_y(mem->ppu, affno);
+    else
+        reload_bg_reference_x(mem->ppu, affno);
+}
+
+// write one byte of a 16-bit register, leaving bits that aren't writeable untouched
+static inline void write_register_byte(uint16_t *reg, uint8_t byte, bool msb, uint16_t writeable)
+{
+    uint16_t mask = msb ? writeable & 0xff00 : writeable & 0x00ff;
+    uint16_t val = msb ? byte << 8 : byte;
+    *reg = (*reg & ~mask) | (val & mask);
+}
+
+/* The 16-bit PPU register behind a display register, or NULL for
+ * anything else, including the BG reference points, which aren't
+ * kept as 16-bit registers
+ */
+static uint16_t *display_register(gba_ppu *ppu, uint32_t normed_addr)
+{
+    switch (normed_addr)
+    {
+        case DISPCNT: return &ppu->dispcnt;
+        case BG0CNT: return &ppu->bg0cnt;
+        case BG1CNT: return &ppu->bg1cnt;
+        case BG2CNT: return &ppu->bg2cnt;
+        case BG3CNT: return &ppu->bg3cnt;
+
+        case BG0HOFS:
+        case BG1HOFS:
+        case BG2HOFS:
+        case BG3HOFS:
+            return ppu->bghoffsets + (normed_addr - BG0HOFS) / 4;
+
+        case BG0VOFS:
+        case BG1VOFS:
+        case BG2VOFS:
+        case BG3VOFS:
+            return ppu->bgvoffsets + (normed_addr - BG0VOFS) / 4;
+
+        case BG2PA: case BG3PA: return ppu->bgpa + (normed_addr - BG2PA) / 0x10;
+        case BG2PB: case BG3PB: return ppu->bgpb + (normed_addr - BG2PB) / 0x10;
+        case BG2PC: case BG3PC: return ppu->bgpc + (normed_addr - BG2PC) / 0x10;
+        case BG2PD: case BG3PD: return ppu->bgpd + (normed_addr - BG2PD) / 0x10;
+
+        case WIN0H: case WIN1H: return ppu->winh + (normed_addr - WIN0H) / 2;
+        case WIN0V: case WIN1V: return ppu->winv + (normed_addr - WIN0V) / 2;
+        case WININ: return &ppu->winin;
+        case WINOUT: return &ppu->winout;
+        case BLDCNT: return &ppu->bldcnt;
+        case BLDALPHA: return &ppu->bldalpha;
+        case BLDY: return &ppu->bldy;
+
+        default: return NULL;
+    }
+}
+
 void write_io_byte(gba_mem *mem, uint32_t addr, uint8_t byte)
 {
     bool msb = addr & 0x1; // addr = upper byte of 16-bit register
     uint32_t normed_addr = addr & ~0x1;
+
+    // Display registers written partway through a scanline only change
+    // the pixels that haven't been displayed yet. Games often rewrite a
+    // whole register to change one byte of it, and rewriting a byte with
+    // the value it already holds changes nothing, so it doesn't split the
+    // line. Comparing against the raw byte is conservative for registers
+    // with bits that can't be written. Writing a reference point always
+    // has an effect, as it reloads the internal one.
+    if (normed_addr >= BG2X_L && normed_addr <= BG3Y_H)
+    {
+        catch_up_scanline(mem->ppu);
+    }
+    else
+    {
+        uint16_t *reg = display_register(mem->ppu, normed_addr);
+        if (reg != NULL && (uint8_t)(msb ? *reg >> 8 : *reg) != byte)
+            catch_up_scanline(mem->ppu);
+    }
+
     switch (normed_addr)
     {
         case DISPCNT:
@@ -116,6 +203,68 @@ void write_io_byte(gba_mem *mem, uint32_t addr, uint8_t byte)
         case BG2VOFS:
         case BG3VOFS:
             write_bg_scroll_register(mem, normed_addr, byte, msb);
+            break;
+
+        case BG2PA:
+        case BG3PA:
+            write_register_byte(mem->ppu->bgpa + (normed_addr - BG2PA) / 0x10, byte, msb, 0xffff);
+            break;
+
+        case BG2PB:
+        case BG3PB:
+            write_register_byte(mem->ppu->bgpb + (normed_addr - BG2PB) / 0x10, byte, msb, 0xffff);
+            break;
+
+        case BG2PC:
+        case BG3PC:
+            write_register_byte(mem->ppu->bgpc + (normed_addr - BG2PC) / 0x10, byte, msb, 0xffff);
+            break;
+
+        case BG2PD:
+        case BG3PD:
+            write_register_byte(mem->ppu->bgpd + (normed_addr - BG2PD) / 0x10, byte, msb, 0xffff);
+            break;
+
+        case BG2X_L:
+        case BG2X_H:
+        case BG2Y_L:
+        case BG2Y_H:
+        case BG3X_L:
+        case BG3X_H:
+        case BG3Y_L:
+        case BG3Y_H:
+            write_bg_reference_point(mem, addr, byte);
+            break;
+
+        case WIN0H:
+        case WIN1H:
+            write_register_byte(mem->ppu->winh + (normed_addr - WIN0H) / 2, byte, msb, 0xffff);
+            break;
+
+        case WIN0V:
+        case WIN1V:
+            write_register_byte(mem->ppu->winv + (normed_addr - WIN0V) / 2, byte, msb, 0xffff);
+            break;
+
+        case WININ:
+            write_register_byte(&mem->ppu->winin, byte, msb, 0x3f3f);
+            break;
+
+        case WINOUT:
+            write_register_byte(&mem->ppu->winout, byte, msb, 0x3f3f);
+            break;
+
+        case BLDCNT:
+            write_register_byte(&mem->ppu->bldcnt, byte, msb, 0x3fff);
+            break;
+
+        case BLDALPHA:
+            write_register_byte(&mem->ppu->bldalpha, byte, msb, 0x1f1f);
+            break;
+
+        case BLDY:
+            write_register_byte(&mem->ppu->bldy, byte, msb, 0x001f);
+            break;
 
         case KEYINPUT: // read-only
             break;
@@ -200,6 +349,34 @@ uint8_t read_io_byte(gba_mem *mem, uint32_t addr)
                 byte = mem->ppu->bg3cnt;
             break;
 
+        case WININ:
+            if (msb)
+                byte = mem->ppu->winin >> 8;
+            else
+                byte = mem->ppu->winin;
+            break;
+
+        case WINOUT:
+            if (msb)
+                byte = mem->ppu->winout >> 8;
+            else
+                byte = mem->ppu->winout;
+            break;
+
+        case BLDCNT:
+            if (msb)
+                byte = mem->ppu->bldcnt >> 8;
+            else
+                byte = mem->ppu->bldcnt;
+            break;
+
+        case BLDALPHA:
+            if (msb)
+                byte = mem->ppu->bldalpha >> 8;
+            else
+                byte = mem->ppu->bldalpha;
+            break;
+
         case KEYINPUT:
             if (msb)
                 byte = mem->gamepad->state >> 8;
@@ -1,18 +1,58 @@
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include "cgba/backend.h"
 #include "cgba/gba.h"
+#include "cgba/movie.h"
+#include "cgba/profiler.h"
+#include "cgba/rewind.h"
+#include "cgba/stats.h"
 
 struct input_args {
     char *biosfile;
     char *romfile;
+    char *record_moviefile;
+    char *play_moviefile;
+    char *statsfile;
+    char *profilefile;
+    char *symbolfile;
+    bool color_correction;
+    bool render_thread;
+    bool headless;
+    bool rewind;
+    int frameskip;
+    int run_ahead;
+    double speed;
+    bool spin;
 };
 
 static void usage(const char *progname)
 {
     fprintf(stderr,
-            "Usage: %s [-b biosfile] <romfile>\n"
+            "Usage: %s [-c] [-t] [-H] [-r] [-S] [-a frames] [-f frames|auto] [-s speed]\n"
+            "       [-R moviefile | -P moviefile] [-I statsfile] [-p profilefile [-m symbolfile]]\n"
+            "       [-b biosfile] <romfile>\n"
             "Options:\n"
-            "-b    Specify a BIOS file to load into the emulator\n",
+            "-a    Show the screen this many frames ahead to cut input lag,\n"
+            "      at the cost of emulating that many more frames each frame\n"
+            "-b    Specify a BIOS file to load into the emulator\n"
+            "-c    Correct colors to approximate the GBA's LCD\n"
+            "-f    Skip drawing this many frames after each one drawn, or\n"
+            "      'auto' to skip frames only when running behind\n"
+            "-H    Run without a window or input, e.g. on servers with no display\n"
+            "-I    Write counts of what the game executed on exit and on F9, as JSON\n"
+            "      if the file name ends in .json and CSV otherwise (needs make STATS=1)\n"
+            "-m    Name functions in the profile after the symbols in an ELF or ld map file\n"
+            "-p    Sample where the game's time goes, and write it to a file on exit\n"
+            "      as folded stacks for flame graphs\n"
+            "-P    Play back the input recorded in a movie, headless and as fast as possible\n"
+            "-R    Record the input of every frame to a movie\n"
+            "-r    Keep a history of the game to rewind through with Backspace\n"
+            "-s    Run at this multiple of the GBA's speed, or 0 for as fast as possible\n"
+            "-S    Spin before each frame for more even frame times, using more CPU\n"
+            "-t    Draw scanlines on a separate thread\n",
             progname);
 }
 
@@ -20,21 +60,129 @@ static int parse_args(int argc, char **argv, struct input_args *args)
 {
     args->biosfile = NULL;
     args->romfile = NULL;
+    args->record_moviefile = NULL;
+    args->play_moviefile = NULL;
+    args->statsfile = NULL;
+    args->profilefile = NULL;
+    args->symbolfile = NULL;
+    args->color_correction = false;
+    args->render_thread = false;
+    args->headless = false;
+    args->rewind = false;
+    args->frameskip = 0;
+    args->run_ahead = 0;
+    args->speed = 1;
+    args->spin = false;
     opterr = false;
 
     int opt;
-    while ((opt = getopt(argc, argv, "b:")) != -1)
+    char *end;
+    while ((opt = getopt(argc, argv, "a:b:cf:HI:m:p:P:rR:s:St")) != -1)
     {
         switch (opt)
         {
+            case 'a':
+                args->run_ahead = strtol(optarg, &end, 10);
+                if (*end != '\0' || end == optarg || args->run_ahead < 0 || args->run_ahead > MAX_RUN_AHEAD)
+                {
+                    fprintf(stderr, "Invalid run-ahead, expected 0 to %d frames: %s\n", MAX_RUN_AHEAD, optarg);
+                    return -1;
+                }
+                break;
+
             case 'b':
                 args->biosfile = optarg;
                 printf("BIOS file supplied: %s\n", args->biosfile);
                 break;
 
+            case 'c':
+                args->color_correction = true;
+                break;
+
+            case 'f':
+                if (!strcmp(optarg, "auto"))
+                {
+                    args->frameskip = FRAMESKIP_AUTO;
+                    break;
+                }
+
+                args->frameskip = strtol(optarg, &end, 10);
+                if (*end != '\0' || end == optarg || args->frameskip < 0)
+                {
+                    fprintf(stderr, "Invalid frameskip: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'H':
+                args->headless = true;
+                break;
+
+            case 'I':
+#ifdef CGBA_STATS
+                args->statsfile = optarg;
+                break;
+#else
+                fputs("Counting stats needs a build with make STATS=1\n", stderr);
+                return -1;
+#endif
+
+            case 'm':
+                args->symbolfile = optarg;
+                break;
+
+            case 'p':
+                args->profilefile = optarg;
+                break;
+
+            case 'P':
+                args->play_moviefile = optarg;
+                args->headless = true;
+                args->speed = 0;
+                break;
+
+            case 'r':
+                args->rewind = true;
+                break;
+
+            case 'R':
+                args->record_moviefile = optarg;
+                break;
+
+            case 's':
+                args->speed = strtod(optarg, &end);
+                if (*end != '\0' || end == optarg || !(args->speed >= 0))
+                {
+                    fprintf(stderr, "Invalid speed: %s\n", optarg);
+                    return -1;
+                }
+                break;
+
+            case 'S':
+                args->spin = true;
+                break;
+
+            case 't':
+                args->render_thread = true;
+                break;
+
             case '?':
                 if (optopt == 'b')
                     fprintf(stderr, "Option '%c' specified but no BIOS file was given\n", optopt);
+                else if (optopt == 'f')
+                    fprintf(stderr, "Option '%c' specified but no frameskip was given\n", optopt);
+                else if (optopt == 's')
+                    fprintf(stderr, "Option '%c' specified but no speed was given\n", optopt);
+                else if (optopt == 'I')
+                    fprintf(stderr, "Option '%c' specified but no stats file was given\n", optopt);
+                else if (optopt == 'm')
+                    fprintf(stderr, "Option '%c' specified but no symbol file was given\n", optopt);
+                else if (optopt == 'p')
+                    fprintf(stderr, "Option '%c' specified but no profile file was given\n", optopt);
+                else if (optopt == 'P' || optopt == 'R')
+                    fprintf(stderr, "Option '%c' specified but no movie file was given\n", optopt);
+                else if (optopt == 'a')
+                    fprintf(stderr, "Option '%c' specified but no number of frames was given\n", optopt);
                 else
                     fprintf(stderr, "Unrecognized option: '%c'\n", optopt);
                 // fallthrough
@@ -47,11 +195,52 @@ static int parse_args(int argc, char **argv, struct input_args *args)
     if (optind != argc - 1)
         return -1;
 
+    if (args->symbolfile != NULL && args->profilefile == NULL)
+    {
+        fputs("Symbols are only used when profiling (-p)\n", stderr);
+        return -1;
+    }
+
+    if (args->record_moviefile != NULL && args->play_moviefile != NULL)
+    {
+        fputs("Can't record and play a movie at once\n", stderr);
+        return -1;
+    }
+
+    // going back in time would make the movie's frames out of order
+    if (args->rewind && (args->record_moviefile != NULL || args->play_moviefile != NULL))
+    {
+        puts("Rewinding is off while recording or playing a movie");
+        args->rewind = false;
+    }
+
     args->romfile = argv[optind];
 
     return 0;
 }
 
+static gba_backend *create_backend_or_die(bool headless)
+{
+    gba_backend *backend;
+
+#ifdef CGBA_HEADLESS
+    if (!headless)
+        puts("Built without SDL, running headless");
+
+    backend = create_headless_backend();
+#else
+    backend = headless ? create_headless_backend() : create_sdl_backend();
+#endif
+
+    if (backend == NULL)
+    {
+        fputs("Failed to set up video and input\n", stderr);
+        exit(1);
+    }
+
+    return backend;
+}
+
 int main(int argc, char **argv)
 {
     gba_system gba;
@@ -67,9 +256,55 @@ int main(int argc, char **argv)
     }
 
     printf("ROM file: %s\n", args.romfile);
-    init_system_or_die(&gba, args.romfile, args.biosfile);
+    init_system_or_die(&gba, args.romfile, args.biosfile, create_backend_or_die(args.headless));
+    gba.ppu->color_correction = args.color_correction;
+    gba.frameskip = args.frameskip;
+    gba.speed = args.speed;
+    init_frame_pacer(&gba.pacer, args.speed, args.spin);
+    if (args.render_thread && enable_render_thread(gba.ppu))
+        fputs("Failed to start render thread, drawing on the emulation thread\n", stderr);
+    if (args.rewind)
+    {
+        gba.rewind = create_rewind_buffer(REWIND_INTERVAL, REWIND_BUFFER_SIZE);
+        if (gba.rewind == NULL)
+            fputs("Failed to set up rewinding, running without it\n", stderr);
+    }
+    if (args.run_ahead && enable_run_ahead(&gba, args.run_ahead))
+        fputs("Failed to set up run-ahead, running without it\n", stderr);
+    if (args.record_moviefile != NULL)
+    {
+        gba.recording = start_movie_recording(args.record_moviefile, gba.mem);
+        if (gba.recording == NULL)
+            exit(1);
+    }
+    if (args.play_moviefile != NULL)
+    {
+        gba.playback = open_movie(args.play_moviefile, gba.mem);
+        if (gba.playback == NULL)
+            exit(1);
+    }
+    gba.statsfile = args.statsfile;
+    if (args.profilefile != NULL)
+    {
+        gba.profiler = create_profiler(PROFILE_INTERVAL);
+        if (gba.profiler == NULL)
+        {
+            fputs("Failed to allocate profiler\n", stderr);
+            exit(1);
+        }
+
+        if (args.symbolfile != NULL && load_profile_symbols(gba.profiler, args.symbolfile))
+            exit(1);
+    }
     report_rom_info(gba.mem->rom);
     run_system(&gba);
+    report_run_ahead_cost(&gba);
+    if (gba.playback != NULL)
+        report_movie_playback(gba.playback, &gba);
+    if (gba.statsfile != NULL)
+        dump_stats(gba.statsfile);
+    if (gba.profiler != NULL)
+        write_profile(gba.profiler, args.profilefile);
     deinit_system(&gba);
 
     return 0;
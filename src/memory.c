@@ -7,6 +7,8 @@
 #include "cgba/cpu.h"
 #include "cgba/io.h"
 #include "cgba/memory.h"
+#include "cgba/ppu.h"
+#include "cgba/stats.h"
 
 // helper to abstract away memory map reads
 static uint8_t byte_from_mmap(gba_mem *mem, uint32_t addr)
@@ -68,7 +70,7 @@ static uint8_t byte_from_mmap(gba_mem *mem, uint32_t addr)
         case 0x0c:
         case 0x0d:
             // TODO: implement the 3 ROM wait states
-            byte = mem->rom[addr & 0x1ffffff];
+            byte = mem->rom[addr & (GBA_ROM_SIZE - 1)];
             break;
 
         case 0x0e: // SRAM
@@ -106,7 +108,11 @@ static void byte_to_mmap(gba_mem *mem, uint32_t addr, uint8_t byte)
             break;
 
         case 0x05: // palette RAM
+            if (mem->palette_ram[addr & 0x3ff] != byte)
+                catch_up_scanline(mem->ppu);
+
             mem->palette_ram[addr & 0x3ff] = byte;
+            mark_palette_dirty(mem->ppu, addr);
             break;
 
         case 0x06: // VRAM
@@ -118,11 +124,13 @@ static void byte_to_mmap(gba_mem *mem, uint32_t addr, uint8_t byte)
             if (offset > 0x17fff)
                 offset -= 0x8000;
             mem->vram[offset] = byte;
+            mark_vram_dirty(mem->ppu, offset);
             break;
         }
 
         case 0x07: // OAM
             mem->oam[addr & 0x3ff] = byte;
+            mark_oam_dirty(mem->ppu);
             break;
 
         case 0x08: // ROM
@@ -143,6 +151,8 @@ static void byte_to_mmap(gba_mem *mem, uint32_t addr, uint8_t byte)
 
 uint32_t read_word(gba_mem *mem, uint32_t addr)
 {
+    COUNT_MEM_ACCESS(STAT_READ, STAT_WORD, addr);
+
     addr &= ~0x3u; // force alignment
     uint32_t val = 0;
 
@@ -157,6 +167,8 @@ uint32_t read_word(gba_mem *mem, uint32_t addr)
 
 uint16_t read_halfword(gba_mem *mem, uint32_t addr)
 {
+    COUNT_MEM_ACCESS(STAT_READ, STAT_HALFWORD, addr);
+
     addr &= ~0x1u; // force alignment
     uint16_t val = 0;
 
@@ -169,11 +181,14 @@ uint16_t read_halfword(gba_mem *mem, uint32_t addr)
 
 uint8_t read_byte(gba_mem *mem, uint32_t addr)
 {
+    COUNT_MEM_ACCESS(STAT_READ, STAT_BYTE, addr);
     return byte_from_mmap(mem, addr);
 }
 
 void write_word(gba_mem *mem, uint32_t addr, uint32_t val)
 {
+    COUNT_MEM_ACCESS(STAT_WRITE, STAT_WORD, addr);
+
     addr &= ~0x3u; // force alignment
     byte_to_mmap(mem, addr, val);
     byte_to_mmap(mem, addr + 1, val >> 8);
@@ -183,6 +198,8 @@ void write_word(gba_mem *mem, uint32_t addr, uint32_t val)
 
 void write_halfword(gba_mem *mem, uint32_t addr, uint16_t val)
 {
+    COUNT_MEM_ACCESS(STAT_WRITE, STAT_HALFWORD, addr);
+
     addr &= ~0x1u; // force alignment
     byte_to_mmap(mem, addr, val);
     byte_to_mmap(mem, addr + 1, val >> 8);
@@ -190,44 +207,53 @@ void write_halfword(gba_mem *mem, uint32_t addr, uint16_t val)
 
 void write_byte(gba_mem *mem, uint32_t addr, uint8_t val)
 {
+    COUNT_MEM_ACCESS(STAT_WRITE, STAT_BYTE, addr);
     byte_to_mmap(mem, addr, val);
 }
 
-static size_t load_rom_or_die(gba_mem *mem, const char *romfile)
+void insert_rom_image(gba_mem *mem, gba_rom *rom)
 {
-    FILE *fptr = fopen(romfile, "rb");
-    if (fptr == NULL)
-        goto open_error;
+    retain_rom_image(rom);
 
-    size_t max_rom_size = sizeof mem->rom;
-    size_t bytes_read = fread(mem->rom, 1, max_rom_size, fptr);
+    if (mem->rom_image != NULL)
+        release_rom_image(mem->rom_image);
 
-    if (bytes_read != max_rom_size && ferror(fptr))
-        goto load_error;
+    mem->rom_image = rom;
+    mem->rom = rom_image_data(rom);
+}
 
-    fclose(fptr);
-    return bytes_read;
+static int insert_new_rom_image(gba_mem *mem, gba_rom *rom)
+{
+    if (rom == NULL)
+        return -1;
 
-load_error:
-    fclose(fptr);
-open_error:
-    perror("Error loading ROM");
-    exit(1);
+    insert_rom_image(mem, rom);
+    release_rom_image(rom);
+    return 0;
 }
 
-gba_mem *init_memory(const char *romfile, const char *biosfile)
+int load_rom_file(gba_mem *mem, const char *romfile)
+{
+    return insert_new_rom_image(mem, load_rom_image(romfile));
+}
+
+int load_rom_buffer(gba_mem *mem, const void *rom, size_t size)
+{
+    return insert_new_rom_image(mem, create_rom_image(rom, size));
+}
+
+gba_mem *init_memory(void)
 {
     gba_mem *mem = malloc(sizeof(gba_mem));
     if (mem == NULL)
         return NULL;
 
     memset(mem, 0, sizeof(gba_mem));
-    load_rom_or_die(mem, romfile);
-
-    if (biosfile != NULL && load_bios_file(mem, biosfile))
-        exit(1);
+    mem->has_bios = false;
 
-    mem->has_bios = biosfile != NULL;
+    // no game inserted yet
+    mem->rom_image = NULL;
+    mem->rom = NULL;
 
     mem->ime_flag = ~1u;
     mem->irq_enable = 0xc000;
@@ -238,5 +264,8 @@ gba_mem *init_memory(const char *romfile, const char *biosfile)
 
 void deinit_memory(gba_mem *mem)
 {
+    if (mem->rom_image != NULL)
+        release_rom_image(mem->rom_image);
+
     free(mem);
 }
@@ -0,0 +1,303 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cgba/gba.h"
+#include "cgba/memory.h"
+#include "cgba/movie.h"
+#include "cgba/rom.h"
+#include "cgba/savestate.h"
+
+#define MOVIE_MAGIC "CGBM"
+
+/* The header is followed by the buttons held on each frame, 16 bits each */
+typedef struct movie_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t rom_hash;
+    uint64_t bios_hash; // 0 when run without a BIOS
+} movie_header;
+
+struct gba_movie {
+    FILE *file;
+
+    // playback: every frame of the movie, read up front
+    uint16_t *frames;
+    size_t num_frames;
+    size_t next_frame;
+    struct timespec start_time;
+
+    // recording: frames are added to one chunk while the other is written
+    uint16_t chunks[2][MOVIE_CHUNK_FRAMES];
+    int recording_chunk;
+    size_t chunk_frames;
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_ready;
+    pthread_cond_t chunk_written;
+    size_t writing_frames; // frames in the chunk being written, 0 when idle
+    bool recording;
+    bool quit;
+};
+
+/* FNV-1a */
+static uint64_t hash_bytes(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 0x100000001b3;
+
+    return hash;
+}
+
+static void hash_game(const gba_mem *mem, movie_header *header)
+{
+    header->rom_hash = hash_bytes(mem->rom, rom_image_size(mem->rom_image));
+    header->bios_hash = mem->has_bios ? hash_bytes(mem->bios, sizeof mem->bios) : 0;
+}
+
+static void *writer_main(void *arg)
+{
+    gba_movie *movie = arg;
+
+    pthread_mutex_lock(&movie->lock);
+    while (true)
+    {
+        while (!movie->writing_frames && !movie->quit)
+            pthread_cond_wait(&movie->chunk_ready, &movie->lock);
+
+        // finish what's been handed over before quitting
+        if (!movie->writing_frames)
+            break;
+
+        const uint16_t *chunk = movie->chunks[movie->recording_chunk ^ 1];
+        size_t num_frames = movie->writing_frames;
+        pthread_mutex_unlock(&movie->lock);
+
+        if (fwrite(chunk, sizeof *chunk, num_frames, movie->file) != num_frames
+            || fflush(movie->file))
+        {
+            perror("Error writing movie");
+        }
+
+        pthread_mutex_lock(&movie->lock);
+        movie->writing_frames = 0;
+        pthread_cond_signal(&movie->chunk_written);
+    }
+    pthread_mutex_unlock(&movie->lock);
+
+    return NULL;
+}
+
+/* Give the frames recorded so far to the writer thread,
+ * and start filling the other chunk
+ */
+static void hand_over_chunk(gba_movie *movie)
+{
+    pthread_mutex_lock(&movie->lock);
+
+    // only if the disk has fallen a whole chunk behind
+    while (movie->writing_frames)
+        pthread_cond_wait(&movie->chunk_written, &movie->lock);
+
+    movie->writing_frames = movie->chunk_frames;
+    movie->recording_chunk ^= 1;
+    pthread_cond_signal(&movie->chunk_ready);
+    pthread_mutex_unlock(&movie->lock);
+
+    movie->chunk_frames = 0;
+}
+
+static gba_movie *alloc_movie(void)
+{
+    gba_movie *movie = malloc(sizeof(gba_movie));
+    if (movie == NULL)
+    {
+        fputs("Failed to allocate movie\n", stderr);
+        return NULL;
+    }
+
+    memset(movie, 0, sizeof(gba_movie));
+    return movie;
+}
+
+gba_movie *start_movie_recording(const char *moviefile, const gba_mem *mem)
+{
+    gba_movie *movie = alloc_movie();
+    if (movie == NULL)
+        return NULL;
+
+    movie->file = fopen(moviefile, "wb");
+    if (movie->file == NULL)
+        goto open_error;
+
+    movie_header header = {
+        .magic = MOVIE_MAGIC,
+        .version = MOVIE_VERSION,
+    };
+    hash_game(mem, &header);
+
+    if (fwrite(&header, sizeof header, 1, movie->file) != 1)
+        goto write_error;
+
+    if (pthread_mutex_init(&movie->lock, NULL))
+        goto write_error;
+
+    if (pthread_cond_init(&movie->chunk_ready, NULL))
+        goto chunk_ready_error;
+
+    if (pthread_cond_init(&movie->chunk_written, NULL))
+        goto chunk_written_error;
+
+    if (pthread_create(&movie->writer, NULL, writer_main, movie))
+        goto thread_error;
+
+    movie->recording = true;
+    return movie;
+
+thread_error:
+    pthread_cond_destroy(&movie->chunk_written);
+chunk_written_error:
+    pthread_cond_destroy(&movie->chunk_ready);
+chunk_ready_error:
+    pthread_mutex_destroy(&movie->lock);
+write_error:
+    fclose(movie->file);
+open_error:
+    perror("Error recording movie");
+    free(movie);
+    return NULL;
+}
+
+gba_movie *open_movie(const char *moviefile, const gba_mem *mem)
+{
+    gba_movie *movie = alloc_movie();
+    if (movie == NULL)
+        return NULL;
+
+    movie->file = fopen(moviefile, "rb");
+    if (movie->file == NULL)
+    {
+        perror("Error opening movie");
+        free(movie);
+        return NULL;
+    }
+
+    movie_header header, expected;
+    if (fread(&header, sizeof header, 1, movie->file) != 1
+        || memcmp(header.magic, MOVIE_MAGIC, sizeof header.magic)
+        || header.version != MOVIE_VERSION)
+    {
+        fprintf(stderr, "%s isn't a version %d movie\n", moviefile, MOVIE_VERSION);
+        goto error;
+    }
+
+    hash_game(mem, &expected);
+    if (header.rom_hash != expected.rom_hash || header.bios_hash != expected.bios_hash)
+    {
+        fprintf(stderr, "%s was recorded with a different game or BIOS\n", moviefile);
+        goto error;
+    }
+
+    // the rest is frames
+    long start = ftell(movie->file);
+    if (start < 0 || fseek(movie->file, 0, SEEK_END))
+        goto read_error;
+
+    long end = ftell(movie->file);
+    if (end < 0 || fseek(movie->file, start, SEEK_SET))
+        goto read_error;
+
+    movie->num_frames = (end - start) / sizeof(uint16_t);
+    movie->frames = malloc(movie->num_frames * sizeof(uint16_t) + 1);
+    if (movie->frames == NULL)
+    {
+        fputs("Failed to allocate movie\n", stderr);
+        goto error;
+    }
+
+    if (fread(movie->frames, sizeof(uint16_t), movie->num_frames, movie->file) != movie->num_frames)
+        goto read_error;
+
+    clock_gettime(CLOCK_MONOTONIC, &movie->start_time);
+    return movie;
+
+read_error:
+    perror("Error reading movie");
+error:
+    free(movie->frames);
+    fclose(movie->file);
+    free(movie);
+    return NULL;
+}
+
+void close_movie(gba_movie *movie)
+{
+    if (movie == NULL)
+        return;
+
+    if (movie->recording)
+    {
+        if (movie->chunk_frames)
+            hand_over_chunk(movie);
+
+        pthread_mutex_lock(&movie->lock);
+        movie->quit = true;
+        pthread_cond_signal(&movie->chunk_ready);
+        pthread_mutex_unlock(&movie->lock);
+        pthread_join(movie->writer, NULL);
+
+        pthread_cond_destroy(&movie->chunk_written);
+        pthread_cond_destroy(&movie->chunk_ready);
+        pthread_mutex_destroy(&movie->lock);
+    }
+
+    free(movie->frames);
+    fclose(movie->file);
+    free(movie);
+}
+
+void record_movie_frame(gba_movie *movie, uint16_t buttons_held)
+{
+    movie->chunks[movie->recording_chunk][movie->chunk_frames++] = buttons_held;
+
+    if (movie->chunk_frames == MOVIE_CHUNK_FRAMES)
+        hand_over_chunk(movie);
+}
+
+bool play_movie_frame(gba_movie *movie, uint16_t *buttons_held)
+{
+    if (movie->next_frame < movie->num_frames)
+        *buttons_held = movie->frames[movie->next_frame++];
+
+    return movie->next_frame < movie->num_frames;
+}
+
+void report_movie_playback(const gba_movie *movie, const gba_system *gba)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (now.tv_sec - movie->start_time.tv_sec)
+                   + (now.tv_nsec - movie->start_time.tv_nsec) / 1e9;
+
+    uint8_t *state = malloc(savestate_size());
+    if (state == NULL)
+        return;
+
+    save_state(gba, state);
+    uint64_t state_hash = hash_bytes(state, savestate_size());
+    free(state);
+
+    printf("Played %zu frames in %.3f s (%.1f fps)\n"
+           "Final state: %016llx\n",
+           movie->next_frame,
+           seconds,
+           movie->next_frame / seconds,
+           (unsigned long long)state_hash);
+}
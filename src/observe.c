@@ -0,0 +1,295 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/cgba.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Luma weights out of 256 for gray observations (BT.601) */
+#define GRAY_R 77
+#define GRAY_G 150
+#define GRAY_B 29
+
+/* Where an output pixel samples the screen: a blend of two neighboring
+ * pixels, weight/256 of the way from src0 to src1
+ */
+typedef struct resample_tap {
+    uint16_t src0;
+    uint16_t src1;
+    uint16_t weight;
+} resample_tap;
+
+struct cgba_observer {
+    int width;
+    int height;
+    int channels;
+    int stack;
+    size_t frame_size; // bytes in one stacked frame
+
+    resample_tap xtaps[CGBA_SCREEN_WIDTH];
+    resample_tap ytaps[CGBA_SCREEN_HEIGHT];
+};
+
+/* Bilinear taps for scaling src_size pixels down (or up) to dst_size,
+ * sampling at the centers of the output pixels
+ */
+static void compute_taps(resample_tap *taps, int dst_size, int src_size)
+{
+    for (int i = 0; i < dst_size; ++i)
+    {
+        // source position of the output pixel's center, 16.16 fixed point
+        int64_t center = ((int64_t)(2*i + 1) * src_size << 16) / (2*dst_size) - (1 << 15);
+        if (center < 0)
+            center = 0;
+
+        int src = center >> 16;
+        int weight = ((center & 0xffff) + 0x80) >> 8;
+        if (weight == 256)
+        {
+            ++src;
+            weight = 0;
+        }
+
+        if (src >= src_size - 1)
+        {
+            src = src_size - 1;
+            weight = 0;
+        }
+
+        taps[i].src0 = src;
+        taps[i].src1 = src + (weight != 0);
+        taps[i].weight = weight;
+    }
+}
+
+cgba_observer *cgba_observer_create(int width, int height, int channels, int stack)
+{
+    if (width < 1 || width > CGBA_SCREEN_WIDTH || height < 1 || height > CGBA_SCREEN_HEIGHT)
+        return NULL;
+
+    if ((channels != 1 && channels != 3) || stack < 1)
+        return NULL;
+
+    cgba_observer *observer = malloc(sizeof(cgba_observer));
+    if (observer == NULL)
+        return NULL;
+
+    observer->width = width;
+    observer->height = height;
+    observer->channels = channels;
+    observer->stack = stack;
+    observer->frame_size = (size_t)width * height * channels;
+
+    compute_taps(observer->xtaps, width, CGBA_SCREEN_WIDTH);
+    compute_taps(observer->ytaps, height, CGBA_SCREEN_HEIGHT);
+
+    return observer;
+}
+
+void cgba_observer_destroy(cgba_observer *observer)
+{
+    free(observer);
+}
+
+size_t cgba_observation_size(const cgba_observer *observer)
+{
+    return observer->frame_size * observer->stack;
+}
+
+static inline uint32_t blend_channel(uint32_t a, uint32_t b, int weight)
+{
+    return (a*(256 - weight) + b*weight + 0x80) >> 8;
+}
+
+static inline uint32_t gray_level(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (r*GRAY_R + g*GRAY_G + b*GRAY_B + 0x80) >> 8;
+}
+
+#if defined(__SSE2__)
+/* Blend the 16-bit channels of two rows of pixels */
+static inline __m128i blend_channels(__m128i a, __m128i b, __m128i wa, __m128i wb)
+{
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a, wa), _mm_mullo_epi16(b, wb));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(0x80)), 8);
+}
+
+/* Gray levels of two pixels of 16-bit channels, in 32-bit lanes 0 and 1 */
+static inline __m128i gray_levels(__m128i px)
+{
+    const __m128i coeffs = _mm_set_epi16(0, GRAY_R, GRAY_G, GRAY_B, 0, GRAY_R, GRAY_G, GRAY_B);
+
+    // B*wb + G*wg in even lanes, R*wr in odd ones
+    __m128i sums = _mm_madd_epi16(px, coeffs);
+    sums = _mm_add_epi32(sums, _mm_srli_epi64(sums, 32));
+    return _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 1, 2, 0));
+}
+#endif
+
+/* Blend two screen rows into a row of gray levels */
+static void blend_gray_row(const uint32_t *a, const uint32_t *b, int weight, uint8_t *row)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(256 - weight);
+    const __m128i wb = _mm_set1_epi16(weight);
+    const __m128i round = _mm_set1_epi32(0x80);
+
+    for (; i + 8 <= CGBA_SCREEN_WIDTH; i += 8)
+    {
+        __m128i gray[2];
+        for (int half = 0; half < 2; ++half)
+        {
+            __m128i pa = _mm_loadu_si128((const __m128i *)(a + i + 4*half));
+            __m128i pb = _mm_loadu_si128((const __m128i *)(b + i + 4*half));
+            __m128i lo = blend_channels(_mm_unpacklo_epi8(pa, zero), _mm_unpacklo_epi8(pb, zero), wa, wb);
+            __m128i hi = blend_channels(_mm_unpackhi_epi8(pa, zero), _mm_unpackhi_epi8(pb, zero), wa, wb);
+            gray[half] = _mm_unpacklo_epi64(gray_levels(lo), gray_levels(hi));
+            gray[half] = _mm_srli_epi32(_mm_add_epi32(gray[half], round), 8);
+        }
+
+        __m128i words = _mm_packs_epi32(gray[0], gray[1]);
+        _mm_storel_epi64((__m128i *)(row + i), _mm_packus_epi16(words, zero));
+    }
+#endif
+
+    for (; i < CGBA_SCREEN_WIDTH; ++i)
+    {
+        uint32_t r = blend_channel((a[i] >> 16) & 0xff, (b[i] >> 16) & 0xff, weight);
+        uint32_t g = blend_channel((a[i] >> 8) & 0xff, (b[i] >> 8) & 0xff, weight);
+        uint32_t bl = blend_channel(a[i] & 0xff, b[i] & 0xff, weight);
+        row[i] = gray_level(r, g, bl);
+    }
+}
+
+/* Blend two screen rows into a row of XRGB8888 pixels */
+static void blend_color_row(const uint32_t *a, const uint32_t *b, int weight, uint32_t *row)
+{
+    if (weight == 0)
+    {
+        memcpy(row, a, CGBA_SCREEN_WIDTH * sizeof(uint32_t));
+        return;
+    }
+
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(256 - weight);
+    const __m128i wb = _mm_set1_epi16(weight);
+
+    for (; i + 4 <= CGBA_SCREEN_WIDTH; i += 4)
+    {
+        __m128i pa = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i pb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = blend_channels(_mm_unpacklo_epi8(pa, zero), _mm_unpacklo_epi8(pb, zero), wa, wb);
+        __m128i hi = blend_channels(_mm_unpackhi_epi8(pa, zero), _mm_unpackhi_epi8(pb, zero), wa, wb);
+        _mm_storeu_si128((__m128i *)(row + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < CGBA_SCREEN_WIDTH; ++i)
+    {
+        uint32_t px = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+            px |= blend_channel((a[i] >> shift) & 0xff, (b[i] >> shift) & 0xff, weight) << shift;
+
+        row[i] = px;
+    }
+}
+
+/* Resample one frame into an observation slot. Each output row is
+ * blended from two screen rows at full width, then scaled across.
+ */
+static void observe_frame(const cgba_observer *observer, const uint32_t *frame, uint8_t *dst)
+{
+    alignas(16) uint8_t gray_row[CGBA_SCREEN_WIDTH];
+    alignas(16) uint32_t color_row[CGBA_SCREEN_WIDTH];
+
+    for (int y = 0; y < observer->height; ++y)
+    {
+        const resample_tap *ytap = &observer->ytaps[y];
+        const uint32_t *a = frame + ytap->src0 * CGBA_SCREEN_WIDTH;
+        const uint32_t *b = frame + ytap->src1 * CGBA_SCREEN_WIDTH;
+
+        // at full width the rows go straight to the observation
+        bool unscaled = observer->width == CGBA_SCREEN_WIDTH;
+
+        if (observer->channels == 1 && unscaled)
+        {
+            blend_gray_row(a, b, ytap->weight, dst);
+            dst += CGBA_SCREEN_WIDTH;
+        }
+        else if (observer->channels == 1)
+        {
+            blend_gray_row(a, b, ytap->weight, gray_row);
+
+            for (int x = 0; x < observer->width; ++x)
+            {
+                const resample_tap *xtap = &observer->xtaps[x];
+                *dst++ = blend_channel(gray_row[xtap->src0], gray_row[xtap->src1], xtap->weight);
+            }
+        }
+        else if (unscaled)
+        {
+            blend_color_row(a, b, ytap->weight, color_row);
+
+            for (int x = 0; x < CGBA_SCREEN_WIDTH; ++x)
+            {
+                *dst++ = color_row[x] >> 16;
+                *dst++ = color_row[x] >> 8;
+                *dst++ = color_row[x];
+            }
+        }
+        else
+        {
+            blend_color_row(a, b, ytap->weight, color_row);
+
+            for (int x = 0; x < observer->width; ++x)
+            {
+                const resample_tap *xtap = &observer->xtaps[x];
+                uint32_t p0 = color_row[xtap->src0];
+                uint32_t p1 = color_row[xtap->src1];
+
+                *dst++ = blend_channel((p0 >> 16) & 0xff, (p1 >> 16) & 0xff, xtap->weight);
+                *dst++ = blend_channel((p0 >> 8) & 0xff, (p1 >> 8) & 0xff, xtap->weight);
+                *dst++ = blend_channel(p0 & 0xff, p1 & 0xff, xtap->weight);
+            }
+        }
+    }
+}
+
+void cgba_observe(const cgba_observer *observer,
+                  const uint32_t **frames,
+                  const bool *restart,
+                  size_t count,
+                  uint8_t *obs)
+{
+    size_t frame_size = observer->frame_size;
+    size_t history_size = frame_size * (observer->stack - 1);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint8_t *stack = obs + i * (history_size + frame_size);
+        uint8_t *newest = stack + history_size;
+
+        // slide the stack along, dropping the oldest frame
+        if (restart == NULL || !restart[i])
+            memmove(stack, stack + frame_size, history_size);
+
+        observe_frame(observer, frames[i], newest);
+
+        // a new episode has no history, so it's all the first frame
+        if (restart != NULL && restart[i])
+        {
+            for (uint8_t *slot = stack; slot != newest; slot += frame_size)
+                memcpy(slot, newest, frame_size);
+        }
+    }
+}
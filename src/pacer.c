@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "cgba/cpu.h"
+#include "cgba/pacer.h"
+
+#define NS_PER_SEC 1000000000
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline_ns)
+{
+    struct timespec deadline = {
+        .tv_sec = deadline_ns / NS_PER_SEC,
+        .tv_nsec = deadline_ns % NS_PER_SEC,
+    };
+
+#ifdef TIMER_ABSTIME
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+        ;
+#else
+    // no absolute sleeps (macOS), so sleep for what's left
+    uint64_t now = monotonic_ns();
+    if (now < deadline_ns)
+    {
+        struct timespec duration = {
+            .tv_sec = (deadline_ns - now) / NS_PER_SEC,
+            .tv_nsec = (deadline_ns - now) % NS_PER_SEC,
+        };
+        nanosleep(&duration, NULL);
+    }
+#endif
+}
+
+static void restart_pacing(frame_pacer *pacer)
+{
+    pacer->start_ns = monotonic_ns();
+    pacer->frames = 0;
+}
+
+void init_frame_pacer(frame_pacer *pacer, double speed, bool spin)
+{
+    pacer->spin = spin;
+    set_pacer_speed(pacer, speed);
+}
+
+void set_pacer_speed(frame_pacer *pacer, double speed)
+{
+    if (speed > 0)
+        pacer->frame_ns = (double)GBA_CYCLES_PER_FRAME * NS_PER_SEC / GBA_CPU_FREQ / speed;
+    else
+        pacer->frame_ns = 0;
+
+    restart_pacing(pacer);
+}
+
+bool wait_for_next_frame(frame_pacer *pacer)
+{
+    if (pacer->frame_ns == 0)
+        return false;
+
+    ++pacer->frames;
+    uint64_t deadline = pacer->start_ns + (uint64_t)(pacer->frames * pacer->frame_ns);
+    uint64_t now = monotonic_ns();
+
+    if (now >= deadline)
+    {
+        if (now - deadline > PACER_MAX_LAG_FRAMES * pacer->frame_ns)
+            restart_pacing(pacer);
+
+        return true;
+    }
+
+    if (!pacer->spin)
+    {
+        sleep_until(deadline);
+        return false;
+    }
+
+    if (deadline - now > PACER_SPIN_NS)
+        sleep_until(deadline - PACER_SPIN_NS);
+
+    while (monotonic_ns() < deadline)
+        ;
+
+    return false;
+}
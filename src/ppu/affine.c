@@ -0,0 +1,231 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/error.h"
+#include "cgba/ppu.h"
+#include "render.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Rotation/scaling BGs are square maps of 8bpp tiles,
+ * with one byte per tile map entry
+ */
+typedef struct affine_bg {
+    // 20.8 fixed-point map coordinates of the first pixel
+    // drawn, and the step from one pixel to the next
+    int32_t x;
+    int32_t y;
+    int32_t pa;
+    int32_t pc;
+
+    int32_t size_mask;      // map side length in pixels - 1
+    int map_row_shift;      // log2 of the map side length in tiles
+    uint32_t map_base;
+    uint32_t tile_base;
+    bool wrap;
+} affine_bg;
+
+static const int affine_bg_px_sizes_log2[4] = {7, 8, 9, 10};
+
+#if defined(__AVX2__)
+static void draw_affine_pixels(const affine_bg *bg, const uint8_t *vram, uint8_t *px_palette_idxs, int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i byte_mask = _mm256_set1_epi32(0xff);
+    const __m256i seven = _mm256_set1_epi32(7);
+    const __m256i size_mask = _mm256_set1_epi32(bg->size_mask);
+    const __m256i map_base = _mm256_set1_epi32(bg->map_base);
+    const __m256i tile_base = _mm256_set1_epi32(bg->tile_base);
+    const __m128i map_row_shift = _mm_cvtsi32_si128(bg->map_row_shift);
+    const __m256i pack_order = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i x = _mm256_add_epi32(_mm256_set1_epi32(bg->x),
+                                 _mm256_mullo_epi32(lanes, _mm256_set1_epi32(bg->pa)));
+    __m256i y = _mm256_add_epi32(_mm256_set1_epi32(bg->y),
+                                 _mm256_mullo_epi32(lanes, _mm256_set1_epi32(bg->pc)));
+    const __m256i dx = _mm256_set1_epi32(8 * bg->pa);
+    const __m256i dy = _mm256_set1_epi32(8 * bg->pc);
+
+    for (int i = 0; i < n; i += 8)
+    {
+        __m256i tx = _mm256_srai_epi32(x, 8);
+        __m256i ty = _mm256_srai_epi32(y, 8);
+        __m256i visible;
+
+        if (bg->wrap)
+        {
+            tx = _mm256_and_si256(tx, size_mask);
+            ty = _mm256_and_si256(ty, size_mask);
+            visible = _mm256_cmpeq_epi32(zero, zero);
+        }
+        else
+        {
+            __m256i outside = _mm256_andnot_si256(size_mask, _mm256_or_si256(tx, ty));
+            visible = _mm256_cmpeq_epi32(outside, zero);
+        }
+
+        x = _mm256_add_epi32(x, dx);
+        y = _mm256_add_epi32(y, dy);
+
+        if (!_mm256_movemask_epi8(visible))
+        {
+            memset(px_palette_idxs + i, 0, 8);
+            continue;
+        }
+
+        __m256i map_offset = _mm256_add_epi32(
+            map_base,
+            _mm256_add_epi32(_mm256_sll_epi32(_mm256_srli_epi32(ty, 3), map_row_shift),
+                             _mm256_srli_epi32(tx, 3)));
+
+        // Every offset is well below the end of VRAM, so reading
+        // whole dwords and keeping the low byte stays in bounds
+        __m256i tileno = _mm256_mask_i32gather_epi32(zero, (const int *)vram, map_offset, visible, 1);
+        tileno = _mm256_and_si256(tileno, byte_mask);
+
+        __m256i tile_offset = _mm256_add_epi32(
+            _mm256_add_epi32(tile_base, _mm256_slli_epi32(tileno, 6)),
+            _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(ty, seven), 3),
+                             _mm256_and_si256(tx, seven)));
+
+        __m256i idx = _mm256_mask_i32gather_epi32(zero, (const int *)vram, tile_offset, visible, 1);
+        idx = _mm256_and_si256(idx, byte_mask);
+
+        // narrow the eight indices to bytes; each 128-bit lane packs its own four
+        idx = _mm256_packus_epi32(idx, idx);
+        idx = _mm256_packus_epi16(idx, idx);
+        idx = _mm256_permutevar8x32_epi32(idx, pack_order);
+        _mm_storel_epi64((__m128i *)(px_palette_idxs + i), _mm256_castsi256_si128(idx));
+    }
+}
+#elif defined(__SSE2__)
+static void draw_affine_pixels(const affine_bg *bg, const uint8_t *vram, uint8_t *px_palette_idxs, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i seven = _mm_set1_epi32(7);
+    const __m128i size_mask = _mm_set1_epi32(bg->size_mask);
+    const __m128i map_base = _mm_set1_epi32(bg->map_base);
+    const __m128i tile_base = _mm_set1_epi32(bg->tile_base);
+    const __m128i map_row_shift = _mm_cvtsi32_si128(bg->map_row_shift);
+
+    __m128i x = _mm_setr_epi32(bg->x, bg->x + bg->pa, bg->x + 2*bg->pa, bg->x + 3*bg->pa);
+    __m128i y = _mm_setr_epi32(bg->y, bg->y + bg->pc, bg->y + 2*bg->pc, bg->y + 3*bg->pc);
+    const __m128i dx = _mm_set1_epi32(4 * bg->pa);
+    const __m128i dy = _mm_set1_epi32(4 * bg->pc);
+
+    alignas(16) uint32_t map_offsets[4];
+    alignas(16) uint32_t px_offsets[4];
+
+    for (int i = 0; i < n; i += 4)
+    {
+        __m128i tx = _mm_srai_epi32(x, 8);
+        __m128i ty = _mm_srai_epi32(y, 8);
+        int visible;
+
+        if (bg->wrap)
+        {
+            tx = _mm_and_si128(tx, size_mask);
+            ty = _mm_and_si128(ty, size_mask);
+            visible = 0xf;
+        }
+        else
+        {
+            __m128i outside = _mm_andnot_si128(size_mask, _mm_or_si128(tx, ty));
+            visible = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(outside, zero)));
+        }
+
+        x = _mm_add_epi32(x, dx);
+        y = _mm_add_epi32(y, dy);
+
+        __m128i map_offset = _mm_add_epi32(
+            map_base,
+            _mm_add_epi32(_mm_sll_epi32(_mm_srli_epi32(ty, 3), map_row_shift),
+                          _mm_srli_epi32(tx, 3)));
+
+        __m128i px_offset = _mm_add_epi32(
+            tile_base,
+            _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(ty, seven), 3),
+                          _mm_and_si128(tx, seven)));
+
+        _mm_store_si128((__m128i *)map_offsets, map_offset);
+        _mm_store_si128((__m128i *)px_offsets, px_offset);
+
+        // no gathers before AVX2
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            uint8_t idx = 0;
+            if (visible & (1 << lane))
+                idx = vram[px_offsets[lane] + TILE_8BPP_SIZE*vram[map_offsets[lane]]];
+            px_palette_idxs[i + lane] = idx;
+        }
+    }
+}
+#else
+static void draw_affine_pixels(const affine_bg *bg, const uint8_t *vram, uint8_t *px_palette_idxs, int n)
+{
+    int32_t x = bg->x;
+    int32_t y = bg->y;
+
+    for (int i = 0; i < n; ++i, x += bg->pa, y += bg->pc)
+    {
+        int32_t tx = x >> 8;
+        int32_t ty = y >> 8;
+
+        if (bg->wrap)
+        {
+            tx &= bg->size_mask;
+            ty &= bg->size_mask;
+        }
+        else if ((tx | ty) & ~bg->size_mask)
+        {
+            px_palette_idxs[i] = 0;
+            continue;
+        }
+
+        uint32_t map_offset = bg->map_base + ((ty >> 3) << bg->map_row_shift) + (tx >> 3);
+        uint32_t tile_offset = bg->tile_base + TILE_8BPP_SIZE*vram[map_offset];
+        px_palette_idxs[i] = vram[tile_offset + TILE_PX_SIDE_LENGTH*(ty & 7) + (tx & 7)];
+    }
+}
+#endif
+
+void render_affine_background(ppu_render_ctx *ctx,
+                              const ppu_line_regs *regs,
+                              enum PPU_BGNO bgno,
+                              int start,
+                              int end,
+                              uint8_t *px_palette_idxs)
+{
+    uint16_t bgcnt = regs->bgcnt[bgno];
+    if (bgcnt & (1 << 6))
+    {
+        fatal_error("Mosaic effect not implemented yet\n");
+    }
+
+    int affno = bgno - PPU_BG2;
+    int size_log2 = affine_bg_px_sizes_log2[(bgcnt >> 14) & 0x3];
+
+    affine_bg bg = {
+        .x = regs->bgx[affno] + start*regs->bgpa[affno],
+        .y = regs->bgy[affno] + start*regs->bgpc[affno],
+        .pa = regs->bgpa[affno],
+        .pc = regs->bgpc[affno],
+        .size_mask = (1 << size_log2) - 1,
+        .map_row_shift = size_log2 - 3,
+        .map_base = 2*KB*((bgcnt >> 8) & 0x1f),
+        .tile_base = 16*KB*((bgcnt >> 2) & 0x3),
+        .wrap = bgcnt & (1 << 13),
+    };
+
+    // Palette index 0 is transparent for 8bpp tiles too, so the
+    // indices can be used as they are. Whole vectors are drawn, so
+    // up to 7 pixels past the span are drawn too, within the padding.
+    draw_affine_pixels(&bg, ctx->vram, px_palette_idxs + start, end - start);
+}
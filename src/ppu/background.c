@@ -0,0 +1,162 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cgba/error.h"
+#include "cgba/ppu.h"
+#include "render.h"
+
+/* screen block dimensions */
+#define SB_PX_SIDE_LENGTH 256
+#define SB_TILE_SIDE_LENGTH (SB_PX_SIDE_LENGTH / TILE_PX_SIDE_LENGTH)
+
+typedef struct tile_entry_data {
+    int tileno;
+    uint32_t palette_bank;
+    bool yflip;
+    bool xflip;
+} tile_entry_data;
+
+static const int text_bg_px_widths[4] = {256, 512, 256, 512};
+static const int text_bg_px_heights[4] = {256, 256, 512, 512};
+
+static const uint8_t transparent_tile_row[TILE_PX_SIDE_LENGTH] = {0};
+
+/* Calculates the effective vcount within a BG map using the vertical scroll of the given BG */
+static inline int get_effective_vcount(const ppu_line_regs *regs, enum PPU_BGNO bgno, int bgsize)
+{
+    int h = text_bg_px_heights[bgsize];
+    int yoff = regs->bgvoffsets[bgno];
+    return ((int)regs->vcount + yoff) & (h - 1);
+}
+
+static inline int get_effective_pixelno(const ppu_line_regs *regs, enum PPU_BGNO bgno, int bgsize, int pixelno)
+{
+    int w = text_bg_px_widths[bgsize];
+    int xoff = regs->bghoffsets[bgno];
+    return (pixelno + xoff) & (w - 1);
+}
+
+void decode_tile(ppu_render_ctx *ctx, uint32_t tileno)
+{
+    const uint8_t *src = ctx->vram + TILE_4BPP_SIZE*tileno;
+    uint8_t *dst = ctx->tile_cache[tileno];
+
+    // pixel arrangement: upper nibble = right, lower nibble = left
+    for (int i = 0; i < TILE_4BPP_SIZE; ++i)
+    {
+        dst[2*i] = src[i] & 0xf;
+        dst[2*i + 1] = src[i] >> 4;
+    }
+
+    ctx->tile_dirty[tileno / 32] &= ~(1u << (tileno % 32));
+}
+
+/* Fetch one row of palette indices of the tile at the given VRAM offset.
+ * 8bpp tiles are stored one index per byte already, so only 4bpp tiles
+ * go through the decoded tile cache.
+ */
+static const uint8_t *fetch_tile_row(ppu_render_ctx *ctx, uint32_t tile_offset, int row, bool four_bit_color)
+{
+    if (!four_bit_color)
+        return ctx->vram + tile_offset + TILE_PX_SIDE_LENGTH*row;
+
+    uint32_t tileno = tile_offset / TILE_4BPP_SIZE;
+    return fetch_decoded_tile(ctx, tileno) + TILE_PX_SIDE_LENGTH*row;
+}
+
+static inline void populate_tile_data(uint16_t tile_map_entry, tile_entry_data *tile_data)
+{
+    tile_data->tileno = tile_map_entry & 0x3ff;
+    tile_data->palette_bank = (tile_map_entry >> 12) & 0xf; // not used in 8-bit color mode
+    tile_data->yflip = tile_map_entry & (1 << 11);
+    tile_data->xflip = tile_map_entry & (1 << 10);
+}
+
+static uint16_t fetch_tile_map_entry(ppu_render_ctx *ctx,
+                                     const ppu_line_regs *regs,
+                                     enum PPU_BGNO bgno,
+                                     int tile_idx)
+{
+    uint16_t bgcnt = regs->bgcnt[bgno];
+    int bgsize = (bgcnt >> 14) & 0x3;
+
+    int w = text_bg_px_widths[bgsize];
+    int effective_vcount = get_effective_vcount(regs, bgno, bgsize);
+
+    // the effective vcount, and tile index within the
+    // currently addressed screen block of the bg map
+    int sb_vcount = effective_vcount & (SB_PX_SIDE_LENGTH - 1);
+    int sb_tile_idx = tile_idx & (SB_TILE_SIDE_LENGTH - 1);
+
+    // The currently addressed screen block within the tile map.
+    // For calculation details, see: https://www.coranac.com/tonc/text/regbg.htm#ssec-map-layout
+    int screen_block_number = (effective_vcount / SB_PX_SIDE_LENGTH) * (w / SB_PX_SIDE_LENGTH)
+                              + (tile_idx / SB_TILE_SIDE_LENGTH);
+
+    int map_base_offset = (bgcnt >> 8) & 0x1f;
+    uint32_t map_base = 2*KB*(map_base_offset + screen_block_number);
+    uint32_t scanline_start = map_base + 2*SB_TILE_SIDE_LENGTH*(sb_vcount / TILE_PX_SIDE_LENGTH);
+
+    return vram_halfword(ctx, scanline_start + 2*sb_tile_idx);
+}
+
+void render_text_background(ppu_render_ctx *ctx,
+                            const ppu_line_regs *regs,
+                            enum PPU_BGNO bgno,
+                            int start,
+                            int end,
+                            uint8_t *px_palette_idxs)
+{
+    uint16_t bgcnt = regs->bgcnt[bgno];
+    if (bgcnt & (1 << 6))
+    {
+        fatal_error("Mosaic effect not implemented yet\n");
+    }
+
+    int bgsize = (bgcnt >> 14) & 0x3;
+    bool four_bit_color = !(bgcnt & (1 << 7));
+    int effective_vcount = get_effective_vcount(regs, bgno, bgsize);
+    int tile_vcount = effective_vcount % TILE_PX_SIDE_LENGTH;
+    uint32_t tile_base_offset = (bgcnt >> 2) & 0x3;
+    uint32_t tile_base = 16*KB*tile_base_offset;
+
+    int tile_map_entry_number = -1;
+    uint16_t tile_map_entry;
+    tile_entry_data tile_data = {0};
+    const uint8_t *tile_row = NULL;
+    // NOTE: 8-bit color mode has one palette w/256 colors
+    uint32_t palette_start = 0;
+    for (int pixels_fetched = start; pixels_fetched < end; ++pixels_fetched)
+    {
+        int effective_pixelno = get_effective_pixelno(regs, bgno, bgsize, pixels_fetched);
+        int tile_pixelno = effective_pixelno % TILE_PX_SIDE_LENGTH;
+
+        int tmp_tile_entry_no = effective_pixelno / TILE_PX_SIDE_LENGTH;
+        if (tmp_tile_entry_no != tile_map_entry_number)
+        {
+            tile_map_entry_number = tmp_tile_entry_no;
+            tile_map_entry = fetch_tile_map_entry(ctx, regs, bgno, tile_map_entry_number);
+            populate_tile_data(tile_map_entry, &tile_data);
+
+            int yoffset = tile_data.yflip ? 7 - tile_vcount : tile_vcount;
+            uint32_t tile_size = four_bit_color ? TILE_4BPP_SIZE : TILE_8BPP_SIZE;
+            uint32_t tile_offset = tile_base + tile_size*tile_data.tileno;
+
+            if (tile_offset < BG_VRAM_SIZE)
+                tile_row = fetch_tile_row(ctx, tile_offset, yoffset, four_bit_color);
+            else
+                tile_row = transparent_tile_row;
+
+            // 16 palette banks w/16 colors each
+            if (four_bit_color)
+                palette_start = 16*tile_data.palette_bank;
+        }
+
+        int xoffset = tile_data.xflip ? 7 - tile_pixelno : tile_pixelno;
+        uint32_t colorno = tile_row[xoffset];
+
+        // color index 0 indicates a transparent pixel (encoded as a palette index of 0)
+        px_palette_idxs[pixels_fetched] = colorno ? palette_start + colorno : 0;
+    }
+}
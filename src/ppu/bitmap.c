@@ -0,0 +1,290 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "cgba/ppu.h"
+#include "render.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* offset of the second frame of the page-flipped modes 4 and 5 */
+#define BITMAP_PAGE_SIZE 0xa000
+
+typedef struct bitmap_format {
+    int width;
+    int height;
+    bool paletted; // 8bpp palette indices, else XBGR1555 colors
+    bool paged;
+} bitmap_format;
+
+static const bitmap_format bitmap_formats[6] = {
+    [3] = {240, 160, false, false},
+    [4] = {240, 160, true,  true},
+    [5] = {160, 128, false, true},
+};
+
+/* A row of the bitmap that lands on the scanline unscaled and unrotated */
+typedef struct bitmap_run {
+    int screen_x; // first pixel of the scanline covered
+    int length;   // 0 when the bitmap doesn't cover the scanline
+    uint32_t src; // bitmap pixel number of the first pixel
+} bitmap_run;
+
+#if defined(__AVX2__)
+static inline __m256i expand_color_channels(__m256i c)
+{
+    const __m256i channel_mask = _mm256_set1_epi32(0x1f);
+    __m256i r = _mm256_and_si256(c, channel_mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(c, 5), channel_mask);
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(c, 10), channel_mask);
+
+    r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+    g = _mm256_or_si256(_mm256_slli_epi32(g, 3), _mm256_srli_epi32(g, 2));
+    b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+
+    return _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+#elif defined(__SSE2__)
+static inline __m128i expand_color_channels(__m128i c)
+{
+    const __m128i channel_mask = _mm_set1_epi32(0x1f);
+    __m128i r = _mm_and_si128(c, channel_mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(c, 5), channel_mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(c, 10), channel_mask);
+
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 3), _mm_srli_epi32(g, 2));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+
+    return _mm_or_si128(_mm_slli_epi32(r, 16), _mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+#endif
+
+/* Convert a run of XBGR1555 colors straight from VRAM */
+static void convert_colors(ppu_render_ctx *ctx, const uint8_t *src, uint32_t *dst, int n)
+{
+    int i = 0;
+
+    // color correction mixes channels, so it's left to convert_color
+    if (!ctx->color_correction)
+    {
+#if defined(__AVX2__)
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256i c = _mm256_loadu_si256((const __m256i *)(src + 2*i));
+            __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(c));
+            __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(c, 1));
+            _mm256_storeu_si256((__m256i *)(dst + i), expand_color_channels(lo));
+            _mm256_storeu_si256((__m256i *)(dst + i + 8), expand_color_channels(hi));
+        }
+#elif defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(src + 2*i));
+            __m128i lo = _mm_unpacklo_epi16(c, zero);
+            __m128i hi = _mm_unpackhi_epi16(c, zero);
+            _mm_storeu_si128((__m128i *)(dst + i), expand_color_channels(lo));
+            _mm_storeu_si128((__m128i *)(dst + i + 4), expand_color_channels(hi));
+        }
+#endif
+    }
+
+    for (; i < n; ++i)
+        dst[i] = convert_color(ctx, src[2*i] | src[2*i + 1] << 8);
+}
+
+/* Look up a run of palette indices in the converted palette.
+ * Index 0 gives the backdrop color, which is what shows through.
+ */
+static void lookup_colors(ppu_render_ctx *ctx, const uint8_t *src, uint32_t *dst, int n)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    const int *palette = (const int *)ctx->palette_cache;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i idx = _mm_loadu_si128((const __m128i *)(src + i));
+        __m256i lo = _mm256_cvtepu8_epi32(idx);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_i32gather_epi32(palette, lo, 4));
+        _mm256_storeu_si256((__m256i *)(dst + i + 8), _mm256_i32gather_epi32(palette, hi, 4));
+    }
+#elif defined(__SSE2__)
+    // no gathers before AVX2, so only the stores are vectorized
+    const uint32_t *palette = ctx->palette_cache;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i c = _mm_setr_epi32(palette[src[i]], palette[src[i + 1]],
+                                   palette[src[i + 2]], palette[src[i + 3]]);
+        _mm_storeu_si128((__m128i *)(dst + i), c);
+    }
+#endif
+
+    for (; i < n; ++i)
+        dst[i] = ctx->palette_cache[src[i]];
+}
+
+static inline bool bitmap_unscaled(const ppu_line_regs *regs)
+{
+    return regs->bgpa[0] == 0x100 && regs->bgpc[0] == 0;
+}
+
+/* Find the part of pixels [start, end) covered by an unscaled bitmap.
+ * Every pixel moves one bitmap pixel to the right, so it's a single run.
+ */
+static bitmap_run find_bitmap_run(const ppu_line_regs *regs, const bitmap_format *fmt, int start, int end)
+{
+    bitmap_run run = {0};
+    int x = regs->bgx[0] >> 8;
+    int y = regs->bgy[0] >> 8;
+
+    if (y < 0 || y >= fmt->height)
+        return run;
+
+    if (start < -x)
+        start = -x;
+    if (end > fmt->width - x)
+        end = fmt->width - x;
+    if (start >= end)
+        return run;
+
+    run.screen_x = start;
+    run.length = end - start;
+    run.src = fmt->width*y + x + start;
+    return run;
+}
+
+/* Draw BG2 straight into pixels [start, end) of the frame buffer over the backdrop */
+static void draw_bitmap_line(ppu_render_ctx *ctx,
+                             const bitmap_format *fmt,
+                             const uint8_t *page,
+                             bitmap_run run,
+                             int start,
+                             int end,
+                             uint32_t *line)
+{
+    uint32_t backdrop = ctx->palette_cache[0];
+
+    // an empty run covers nothing, wherever it says it starts
+    if (!run.length)
+        run.screen_x = end;
+
+    for (int x = start; x < run.screen_x; ++x)
+        line[x] = backdrop;
+
+    if (fmt->paletted)
+        lookup_colors(ctx, page + run.src, line + run.screen_x, run.length);
+    else
+        convert_colors(ctx, page + 2*run.src, line + run.screen_x, run.length);
+
+    for (int x = run.screen_x + run.length; x < end; ++x)
+        line[x] = backdrop;
+}
+
+/* Sample a bitmap pixel, returning false outside of the bitmap */
+static inline bool fetch_bitmap_pixel(const bitmap_format *fmt,
+                                      const uint8_t *page,
+                                      int32_t x,
+                                      int32_t y,
+                                      uint16_t *pixel)
+{
+    int tx = x >> 8;
+    int ty = y >> 8;
+
+    if (tx < 0 || tx >= fmt->width || ty < 0 || ty >= fmt->height)
+        return false;
+
+    uint32_t pixelno = fmt->width*ty + tx;
+    if (fmt->paletted)
+        *pixel = page[pixelno];
+    else
+        *pixel = page[2*pixelno] | page[2*pixelno + 1] << 8;
+
+    return true;
+}
+
+/* Draw pixels [start, end) of BG2 into the compositor's layers */
+static void draw_bitmap_layer(const ppu_line_regs *regs,
+                              const bitmap_format *fmt,
+                              const uint8_t *page,
+                              int start,
+                              int end,
+                              scanline_layers *layers)
+{
+    uint8_t *px = layers->bg[PPU_BG2];
+    memset(px, 0, SCANLINE_BUF_WIDTH);
+    layers->bg2_direct = !fmt->paletted;
+
+    int32_t x = regs->bgx[0] + start*regs->bgpa[0];
+    int32_t y = regs->bgy[0] + start*regs->bgpc[0];
+
+    for (int i = start; i < end; ++i, x += regs->bgpa[0], y += regs->bgpc[0])
+    {
+        uint16_t pixel;
+        if (!fetch_bitmap_pixel(fmt, page, x, y, &pixel))
+            continue;
+
+        // every direct color pixel is opaque, and index 0 is transparent
+        if (fmt->paletted)
+        {
+            px[i] = pixel;
+        }
+        else
+        {
+            px[i] = 1;
+            layers->bg2_colors[i] = pixel;
+        }
+    }
+}
+
+void render_bitmap_scanline(ppu_render_ctx *ctx,
+                            const ppu_line_regs *regs,
+                            int mode,
+                            int start,
+                            int end,
+                            uint32_t *line)
+{
+    const bitmap_format *fmt = &bitmap_formats[mode];
+
+    const uint8_t *page = ctx->vram;
+    if (fmt->paged && (regs->dispcnt & (1 << 4)))
+        page += BITMAP_PAGE_SIZE;
+
+    bool bg2_enabled = regs->dispcnt & (1 << 10);
+    bool obj_enabled = regs->dispcnt & (1 << 12);
+    bool windows = regs->dispcnt & (0x7 << 13);
+    bool effects = (regs->bldcnt >> 6) & 0x3;
+
+    // With nothing but BG2 over the backdrop, as when playing video,
+    // lines are converted straight into the frame buffer
+    if (!obj_enabled && !windows && !effects && (!bg2_enabled || bitmap_unscaled(regs)))
+    {
+        bitmap_run run = {0};
+        if (bg2_enabled)
+            run = find_bitmap_run(regs, fmt, start, end);
+
+        draw_bitmap_line(ctx, fmt, page, run, start, end, line);
+        return;
+    }
+
+    scanline_layers layers;
+    layers.bg_enabled[PPU_BG0] = false;
+    layers.bg_enabled[PPU_BG1] = false;
+    layers.bg_enabled[PPU_BG2] = bg2_enabled;
+    layers.bg_enabled[PPU_BG3] = false;
+    layers.bg2_direct = false;
+
+    if (bg2_enabled)
+        draw_bitmap_layer(regs, fmt, page, start, end, &layers);
+
+    layers.obj_enabled = obj_enabled;
+    if (obj_enabled)
+        render_objects(ctx, regs, start, end, &layers);
+
+    compose_scanline(ctx, regs, &layers, start, end, line);
+}
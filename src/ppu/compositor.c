@@ -0,0 +1,434 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "cgba/ppu.h"
+#include "render.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum BLEND_EFFECT {
+    EFFECT_NONE,
+    EFFECT_ALPHA,
+    EFFECT_BRIGHTEN,
+    EFFECT_DARKEN,
+};
+
+/* The two topmost visible pixels at each position of the scanline */
+typedef struct resolved_scanline {
+    alignas(32) uint8_t top_idx[SCANLINE_BUF_WIDTH];
+    alignas(32) uint8_t top_layer[SCANLINE_BUF_WIDTH];
+    alignas(32) uint8_t bot_idx[SCANLINE_BUF_WIDTH];
+    alignas(32) uint8_t bot_layer[SCANLINE_BUF_WIDTH];
+} resolved_scanline;
+
+/* OBJs use the second half of palette RAM */
+static const uint16_t layer_palette_base[] = {
+    [LAYER_BG0]  = 0,
+    [LAYER_BG1]  = 0,
+    [LAYER_BG2]  = 0,
+    [LAYER_BG3]  = 0,
+    [LAYER_OBJ]  = 256,
+    [LAYER_BD]   = 0,
+    [LAYER_NONE] = 0,
+};
+
+static inline uint32_t expand_color_channel(uint32_t c)
+{
+    return (c << 3) | (c >> 2);
+}
+
+uint32_t convert_color(ppu_render_ctx *ctx, uint16_t color)
+{
+    uint32_t r = expand_color_channel(color & 0x1f);
+    uint32_t g = expand_color_channel((color >> 5) & 0x1f);
+    uint32_t b = expand_color_channel((color >> 10) & 0x1f);
+
+    if (ctx->color_correction)
+    {
+        // Rough approximation of the GBA LCD, which is darker
+        // and less saturated than a PC monitor. The weights of
+        // each output channel sum to 240/256.
+        uint32_t cr = (196*r +  40*g +   4*b) >> 8;
+        uint32_t cg = ( 24*r + 192*g +  24*b) >> 8;
+        uint32_t cb = (  8*r +  32*g + 200*b) >> 8;
+        r = cr;
+        g = cg;
+        b = cb;
+    }
+
+    return r << 16 | g << 8 | b;
+}
+
+void refresh_palette_cache(ppu_render_ctx *ctx)
+{
+    for (int i = 0; i < PALETTE_NUM_COLORS / 32; ++i)
+    {
+        uint32_t dirty = ctx->palette_dirty[i];
+        ctx->palette_dirty[i] = 0;
+
+        while (dirty)
+        {
+            int colorno = 32*i + __builtin_ctz(dirty);
+            ctx->palette_cache[colorno] = convert_color(ctx, pram_halfword(ctx, 2*colorno));
+            dirty &= dirty - 1; // clear the least significant bit set
+        }
+    }
+}
+
+/* Whether pos is in [start, end). Windows whose start lies
+ * after their end wrap around the edge of the screen.
+ */
+static inline bool in_window_range(int pos, int start, int end, int limit)
+{
+    if (end > limit)
+        end = limit;
+
+    if (start <= end)
+        return pos >= start && pos < end;
+    else
+        return pos >= start || pos < end;
+}
+
+static void fill_window_range(uint8_t *win, uint16_t winh, uint8_t control)
+{
+    int x1 = winh >> 8;
+    int x2 = winh & 0xff;
+
+    for (int x = 0; x < FRAME_WIDTH; ++x)
+    {
+        if (in_window_range(x, x1, x2, FRAME_WIDTH))
+            win[x] = control;
+    }
+}
+
+/* Compute which layers, and whether color special effects,
+ * are enabled at each pixel of the current scanline
+ */
+static void compute_window_mask(const ppu_line_regs *regs, scanline_layers *layers, uint8_t *win)
+{
+    bool win0_enabled = regs->dispcnt & (1 << 13);
+    bool win1_enabled = regs->dispcnt & (1 << 14);
+    bool objwin_enabled = (regs->dispcnt & (1 << 15)) && layers->obj_enabled;
+
+    if (!(regs->dispcnt & (0x7 << 13)))
+    {
+        memset(win, WIN_ALL, SCANLINE_BUF_WIDTH);
+        return;
+    }
+
+    // pixels outside of every window
+    memset(win, regs->winout & WIN_ALL, SCANLINE_BUF_WIDTH);
+
+    // in increasing order of window priority
+    if (objwin_enabled)
+    {
+        uint8_t control = (regs->winout >> 8) & WIN_ALL;
+        for (int x = 0; x < FRAME_WIDTH; ++x)
+        {
+            if (layers->obj_flags[x] & OBJ_WINDOW)
+                win[x] = control;
+        }
+    }
+
+    for (int i = 1; i >= 0; --i)
+    {
+        bool enabled = i ? win1_enabled : win0_enabled;
+        int y1 = regs->winv[i] >> 8;
+        int y2 = regs->winv[i] & 0xff;
+
+        if (enabled && in_window_range(regs->vcount, y1, y2, FRAME_HEIGHT))
+            fill_window_range(win, regs->winh[i], (regs->winin >> 8*i) & WIN_ALL);
+    }
+}
+
+/* Draw one layer over the pixels resolved so far. A pixel is drawn when
+ * it's opaque, the window it's in shows the layer, and, for OBJs, it
+ * has the priority currently being drawn. The vector versions work on
+ * every whole vector overlapping [start, end).
+ */
+static void merge_layer(resolved_scanline *res,
+                        const uint8_t *px,
+                        const uint8_t *win,
+                        const uint8_t *obj_prio,
+                        int prio,
+                        enum PPU_LAYER layer,
+                        int start,
+                        int end)
+{
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i layer_bit = _mm256_set1_epi8(1 << layer);
+    const __m256i layer_no = _mm256_set1_epi8(layer);
+    const __m256i prio_vec = _mm256_set1_epi8(prio);
+
+    for (int x = start & ~31; x < end; x += 32)
+    {
+        __m256i p = _mm256_load_si256((const __m256i *)(px + x));
+        __m256i w = _mm256_load_si256((const __m256i *)(win + x));
+        __m256i shown = _mm256_cmpeq_epi8(_mm256_and_si256(w, layer_bit), layer_bit);
+        __m256i drawn = _mm256_andnot_si256(_mm256_cmpeq_epi8(p, zero), shown);
+
+        if (obj_prio)
+        {
+            __m256i op = _mm256_load_si256((const __m256i *)(obj_prio + x));
+            drawn = _mm256_and_si256(drawn, _mm256_cmpeq_epi8(op, prio_vec));
+        }
+
+        if (!_mm256_movemask_epi8(drawn))
+            continue;
+
+        __m256i *top_idx = (__m256i *)(res->top_idx + x);
+        __m256i *top_layer = (__m256i *)(res->top_layer + x);
+        __m256i *bot_idx = (__m256i *)(res->bot_idx + x);
+        __m256i *bot_layer = (__m256i *)(res->bot_layer + x);
+
+        __m256i ti = _mm256_load_si256(top_idx);
+        __m256i tl = _mm256_load_si256(top_layer);
+        _mm256_store_si256(bot_idx, _mm256_blendv_epi8(_mm256_load_si256(bot_idx), ti, drawn));
+        _mm256_store_si256(bot_layer, _mm256_blendv_epi8(_mm256_load_si256(bot_layer), tl, drawn));
+        _mm256_store_si256(top_idx, _mm256_blendv_epi8(ti, p, drawn));
+        _mm256_store_si256(top_layer, _mm256_blendv_epi8(tl, layer_no, drawn));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i layer_bit = _mm_set1_epi8(1 << layer);
+    const __m128i layer_no = _mm_set1_epi8(layer);
+    const __m128i prio_vec = _mm_set1_epi8(prio);
+
+// select bytes of a where mask is set, otherwise bytes of b
+#define SELECT_EPI8(mask, a, b) \
+    _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+
+    for (int x = start & ~15; x < end; x += 16)
+    {
+        __m128i p = _mm_load_si128((const __m128i *)(px + x));
+        __m128i w = _mm_load_si128((const __m128i *)(win + x));
+        __m128i shown = _mm_cmpeq_epi8(_mm_and_si128(w, layer_bit), layer_bit);
+        __m128i drawn = _mm_andnot_si128(_mm_cmpeq_epi8(p, zero), shown);
+
+        if (obj_prio)
+        {
+            __m128i op = _mm_load_si128((const __m128i *)(obj_prio + x));
+            drawn = _mm_and_si128(drawn, _mm_cmpeq_epi8(op, prio_vec));
+        }
+
+        if (!_mm_movemask_epi8(drawn))
+            continue;
+
+        __m128i *top_idx = (__m128i *)(res->top_idx + x);
+        __m128i *top_layer = (__m128i *)(res->top_layer + x);
+        __m128i *bot_idx = (__m128i *)(res->bot_idx + x);
+        __m128i *bot_layer = (__m128i *)(res->bot_layer + x);
+
+        __m128i ti = _mm_load_si128(top_idx);
+        __m128i tl = _mm_load_si128(top_layer);
+        _mm_store_si128(bot_idx, SELECT_EPI8(drawn, ti, _mm_load_si128(bot_idx)));
+        _mm_store_si128(bot_layer, SELECT_EPI8(drawn, tl, _mm_load_si128(bot_layer)));
+        _mm_store_si128(top_idx, SELECT_EPI8(drawn, p, ti));
+        _mm_store_si128(top_layer, SELECT_EPI8(drawn, layer_no, tl));
+    }
+
+#undef SELECT_EPI8
+#else
+    for (int x = start; x < end; ++x)
+    {
+        bool drawn = px[x]
+                     && (win[x] & (1 << layer))
+                     && (!obj_prio || obj_prio[x] == prio);
+
+        if (drawn)
+        {
+            res->bot_idx[x] = res->top_idx[x];
+            res->bot_layer[x] = res->top_layer[x];
+            res->top_idx[x] = px[x];
+            res->top_layer[x] = layer;
+        }
+    }
+#endif
+}
+
+static inline uint16_t get_raw_color(ppu_render_ctx *ctx,
+                                     const scanline_layers *layers,
+                                     enum PPU_LAYER layer,
+                                     uint8_t idx,
+                                     int x)
+{
+    if (layer == LAYER_BG2 && layers->bg2_direct)
+        return layers->bg2_colors[x];
+
+    return pram_halfword(ctx, 2*(layer_palette_base[layer] + idx));
+}
+
+/* Replace the colors of direct color BG2 pixels, which have
+ * no palette entry, where BG2 ended up on top
+ */
+static void fix_direct_colors(ppu_render_ctx *ctx,
+                              const scanline_layers *layers,
+                              const resolved_scanline *res,
+                              int start,
+                              int end,
+                              uint32_t *line)
+{
+    for (int x = start; x < end; ++x)
+    {
+        if (res->top_layer[x] == LAYER_BG2)
+            line[x] = convert_color(ctx, layers->bg2_colors[x]);
+    }
+}
+
+static uint16_t alpha_blend(uint16_t top, uint16_t bot, int eva, int evb)
+{
+    uint16_t result = 0;
+    for (int shift = 0; shift < 15; shift += 5)
+    {
+        int c = (((top >> shift) & 0x1f)*eva + ((bot >> shift) & 0x1f)*evb) >> 4;
+        result |= (c > 0x1f ? 0x1f : c) << shift;
+    }
+
+    return result;
+}
+
+static uint16_t adjust_brightness(uint16_t color, int evy, bool brighten)
+{
+    uint16_t result = 0;
+    for (int shift = 0; shift < 15; shift += 5)
+    {
+        int c = (color >> shift) & 0x1f;
+        if (brighten)
+            c += ((0x1f - c)*evy) >> 4;
+        else
+            c -= (c*evy) >> 4;
+
+        result |= c << shift;
+    }
+
+    return result;
+}
+
+/* Resolve final colors where color special effects may apply */
+static void apply_effects(ppu_render_ctx *ctx,
+                          const ppu_line_regs *regs,
+                          scanline_layers *layers,
+                          resolved_scanline *res,
+                          const uint8_t *win,
+                          int start,
+                          int end,
+                          uint32_t *line)
+{
+    enum BLEND_EFFECT effect = (regs->bldcnt >> 6) & 0x3;
+    int eva = regs->bldalpha & 0x1f;
+    int evb = (regs->bldalpha >> 8) & 0x1f;
+    int evy = regs->bldy & 0x1f;
+
+    // coefficients saturate at 16/16
+    eva = eva > 16 ? 16 : eva;
+    evb = evb > 16 ? 16 : evb;
+    evy = evy > 16 ? 16 : evy;
+
+    for (int x = start; x < end; ++x)
+    {
+        enum PPU_LAYER top_layer = res->top_layer[x];
+        enum PPU_LAYER bot_layer = res->bot_layer[x];
+        uint8_t top_idx = res->top_idx[x];
+
+        if (top_layer == LAYER_BG2 && layers->bg2_direct)
+            line[x] = convert_color(ctx, layers->bg2_colors[x]);
+        else
+            line[x] = ctx->palette_cache[layer_palette_base[top_layer] + top_idx];
+
+        if (!(win[x] & WIN_EFFECTS))
+            continue;
+
+        // Semi-transparent OBJs are always a first target for alpha
+        // blending. With no second target below one, it gets BLDCNT's
+        // brightness effect instead, but only if it's a first target there.
+        bool semi_transparent = top_layer == LAYER_OBJ
+                                && (layers->obj_flags[x] & OBJ_SEMI_TRANSPARENT);
+        bool bldcnt_target = regs->bldcnt & (1 << top_layer);
+        bool first_target = semi_transparent || bldcnt_target;
+        bool second_target = regs->bldcnt & (1 << (bot_layer + 8));
+
+        if (!first_target)
+            continue;
+
+        uint16_t top = get_raw_color(ctx, layers, top_layer, top_idx, x);
+        uint16_t result;
+        if ((semi_transparent || effect == EFFECT_ALPHA) && second_target)
+        {
+            uint16_t bot = get_raw_color(ctx, layers, bot_layer, res->bot_idx[x], x);
+            result = alpha_blend(top, bot, eva, evb);
+        }
+        else if (bldcnt_target && effect == EFFECT_BRIGHTEN)
+        {
+            result = adjust_brightness(top, evy, true);
+        }
+        else if (bldcnt_target && effect == EFFECT_DARKEN)
+        {
+            result = adjust_brightness(top, evy, false);
+        }
+        else
+        {
+            continue;
+        }
+
+        line[x] = convert_color(ctx, result);
+    }
+}
+
+void compose_scanline(ppu_render_ctx *ctx,
+                      const ppu_line_regs *regs,
+                      scanline_layers *layers,
+                      int start,
+                      int end,
+                      uint32_t *line)
+{
+    alignas(32) uint8_t win[SCANLINE_BUF_WIDTH];
+    resolved_scanline res;
+
+    compute_window_mask(regs, layers, win);
+
+    // start with the backdrop, which has nothing below it
+    memset(res.top_idx, 0, sizeof res.top_idx);
+    memset(res.top_layer, LAYER_BD, sizeof res.top_layer);
+    memset(res.bot_idx, 0, sizeof res.bot_idx);
+    memset(res.bot_layer, LAYER_NONE, sizeof res.bot_layer);
+
+    // Draw back to front. Among BGs of equal priority the lower
+    // numbered BG is on top, and OBJs are on top of BGs that
+    // have the same priority.
+    for (int prio = 3; prio >= 0; --prio)
+    {
+        for (int bgno = PPU_BG3; bgno >= PPU_BG0; --bgno)
+        {
+            if (layers->bg_enabled[bgno] && (regs->bgcnt[bgno] & 0x3) == prio)
+                merge_layer(&res, layers->bg[bgno], win, NULL, prio, (enum PPU_LAYER)bgno, start, end);
+        }
+
+        if (layers->obj_enabled)
+            merge_layer(&res, layers->obj, win, layers->obj_prio, prio, LAYER_OBJ, start, end);
+    }
+
+    bool effects = (regs->bldcnt >> 6) & 0x3;
+    if (layers->obj_enabled)
+    {
+        for (int x = start; x < end && !effects; ++x)
+            effects = layers->obj_flags[x] & OBJ_SEMI_TRANSPARENT;
+    }
+
+    if (effects)
+    {
+        apply_effects(ctx, regs, layers, &res, win, start, end, line);
+        return;
+    }
+
+    for (int x = start; x < end; ++x)
+        line[x] = ctx->palette_cache[layer_palette_base[res.top_layer[x]] + res.top_idx[x]];
+
+    if (layers->bg2_direct)
+        fix_direct_colors(ctx, layers, &res, start, end, line);
+}
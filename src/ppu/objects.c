@@ -0,0 +1,282 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "cgba/ppu.h"
+#include "render.h"
+
+#define OBJ_ATTR_SIZE 8
+
+/* OBJ dimensions in pixels, indexed by shape then size */
+static const uint8_t obj_widths[3][4] = {
+    {8,  16, 32, 64}, // square
+    {16, 32, 32, 64}, // horizontal
+    {8,  8,  16, 32}, // vertical
+};
+
+static const uint8_t obj_heights[3][4] = {
+    {8,  16, 32, 64},
+    {8,  8,  16, 32},
+    {16, 32, 32, 64},
+};
+
+/* Add an OBJ to the list of every visible scanline it covers */
+static void bucket_obj(ppu_render_ctx *ctx, const obj_attrs *obj, uint8_t objno)
+{
+    for (int row = 0; row < obj->box_height; ++row)
+    {
+        uint8_t line = obj->y + row; // wraps around the 256 line space
+
+        if (line < FRAME_HEIGHT)
+            ctx->line_objs[line][ctx->line_obj_counts[line]++] = objno;
+    }
+}
+
+/* Decode every OBJ's attributes and sort the visible ones into the
+ * scanlines they cover, so drawing a scanline only visits its own OBJs
+ */
+static void decode_oam(ppu_render_ctx *ctx)
+{
+    memset(ctx->line_obj_counts, 0, sizeof ctx->line_obj_counts);
+
+    for (int objno = 0; objno < NUM_OBJS; ++objno)
+    {
+        uint16_t attr0 = oam_halfword(ctx, OBJ_ATTR_SIZE*objno);
+        uint16_t attr1 = oam_halfword(ctx, OBJ_ATTR_SIZE*objno + 2);
+        uint16_t attr2 = oam_halfword(ctx, OBJ_ATTR_SIZE*objno + 4);
+
+        bool affine = attr0 & (1 << 8);
+        bool double_size = affine && (attr0 & (1 << 9));
+        bool disabled = !affine && (attr0 & (1 << 9));
+        int mode = (attr0 >> 10) & 0x3;
+        int shape = (attr0 >> 14) & 0x3;
+        int size = (attr1 >> 14) & 0x3;
+
+        // mode 3 and shape 3 are prohibited
+        if (disabled || mode == 3 || shape == 3)
+            continue;
+
+        // off by a few pixels at worst, so not worth stopping the game over
+        static atomic_flag mosaic_warned = ATOMIC_FLAG_INIT;
+        if ((attr0 & (1 << 12)) && !atomic_flag_test_and_set(&mosaic_warned))
+            fputs("OBJ mosaic effect not implemented yet, drawing without it\n", stderr);
+
+        obj_attrs *obj = &ctx->objs[objno];
+        obj->y = attr0 & 0xff;
+        obj->x = (int16_t)(attr1 << 7) >> 7; // sign extend 9-bit x
+        obj->width = obj_widths[shape][size];
+        obj->height = obj_heights[shape][size];
+        obj->box_width = double_size ? 2*obj->width : obj->width;
+        obj->box_height = double_size ? 2*obj->height : obj->height;
+        obj->flags = mode == 1 ? OBJ_SEMI_TRANSPARENT : mode == 2 ? OBJ_WINDOW : 0;
+        obj->affine = affine;
+        obj->eight_bit_color = attr0 & (1 << 13);
+        obj->matrix = (attr1 >> 9) & 0x1f;
+        obj->hflip = !affine && (attr1 & (1 << 12));
+        obj->vflip = !affine && (attr1 & (1 << 13));
+        obj->tileno = attr2 & 0x3ff;
+        obj->priority = (attr2 >> 10) & 0x3;
+        obj->palette_bank = (attr2 >> 12) & 0xf;
+
+        bucket_obj(ctx, obj, objno);
+    }
+
+    // the parameters of each matrix are spread over the
+    // unused fourth halfword of four consecutive OBJs
+    for (int i = 0; i < NUM_OBJ_MATRICES; ++i)
+    {
+        for (int param = 0; param < 4; ++param)
+            ctx->obj_matrices[i][param] = oam_halfword(ctx, 4*OBJ_ATTR_SIZE*i + OBJ_ATTR_SIZE*param + 6);
+    }
+
+    ctx->oam_dirty = false;
+}
+
+/* Number of 32-byte tile units from one row of an OBJ's tiles to the next */
+static inline uint32_t obj_tile_row_stride(const ppu_line_regs *regs, const obj_attrs *obj)
+{
+    bool one_dimensional = regs->dispcnt & (1 << 6);
+
+    if (!one_dimensional)
+        return 32; // OBJ VRAM is laid out as a 32x32 tile matrix
+
+    uint32_t tiles = obj->width / TILE_PX_SIDE_LENGTH;
+    return obj->eight_bit_color ? 2*tiles : tiles;
+}
+
+/* One row of 8 palette indices of the given tile of an OBJ, with
+ * the OBJ palette bank already applied for 4bpp OBJs
+ */
+static inline const uint8_t *fetch_obj_tile_row(ppu_render_ctx *ctx,
+                                                const obj_attrs *obj,
+                                                uint32_t tileno,
+                                                int row,
+                                                uint8_t *buf)
+{
+    tileno &= OBJ_VRAM_MASK / TILE_4BPP_SIZE;
+
+    // 8bpp tiles take two tile numbers, and wrap around the end of OBJ VRAM
+    if (obj->eight_bit_color)
+        return ctx->vram + OBJ_VRAM_BASE
+               + ((TILE_4BPP_SIZE*tileno + TILE_PX_SIDE_LENGTH*row) & OBJ_VRAM_MASK);
+
+    const uint8_t *px = fetch_decoded_tile(ctx, OBJ_VRAM_BASE / TILE_4BPP_SIZE + tileno)
+                        + TILE_PX_SIDE_LENGTH*row;
+    uint8_t palette_start = 16*obj->palette_bank;
+
+    for (int i = 0; i < TILE_PX_SIDE_LENGTH; ++i)
+        buf[i] = px[i] ? palette_start + px[i] : 0;
+
+    return buf;
+}
+
+static inline uint8_t fetch_obj_texel(ppu_render_ctx *ctx,
+                                      const obj_attrs *obj,
+                                      uint32_t row_stride,
+                                      int tx,
+                                      int ty)
+{
+    uint32_t tile_step = obj->eight_bit_color ? 2 : 1;
+    uint32_t tileno = obj->tileno + row_stride*(ty / 8) + tile_step*(tx / 8);
+    tileno &= OBJ_VRAM_MASK / TILE_4BPP_SIZE;
+
+    if (obj->eight_bit_color)
+    {
+        uint32_t offset = TILE_4BPP_SIZE*tileno + TILE_PX_SIDE_LENGTH*(ty & 7) + (tx & 7);
+        return ctx->vram[OBJ_VRAM_BASE + (offset & OBJ_VRAM_MASK)];
+    }
+
+    const uint8_t *px = fetch_decoded_tile(ctx, OBJ_VRAM_BASE / TILE_4BPP_SIZE + tileno);
+    uint8_t colorno = px[TILE_PX_SIDE_LENGTH*(ty & 7) + (tx & 7)];
+    return colorno ? 16*obj->palette_bank + colorno : 0;
+}
+
+/* Draw one opaque OBJ pixel. OBJs are drawn in OAM order, so an
+ * earlier OBJ is only drawn over by one of higher priority.
+ */
+static inline void draw_obj_pixel(scanline_layers *layers, const obj_attrs *obj, int x, uint8_t idx)
+{
+    if (obj->flags & OBJ_WINDOW)
+    {
+        layers->obj_flags[x] |= OBJ_WINDOW;
+        return;
+    }
+
+    if (layers->obj[x] && layers->obj_prio[x] <= obj->priority)
+        return;
+
+    layers->obj[x] = idx;
+    layers->obj_prio[x] = obj->priority;
+    layers->obj_flags[x] = (layers->obj_flags[x] & OBJ_WINDOW) | obj->flags;
+}
+
+static void draw_regular_obj(ppu_render_ctx *ctx,
+                             const ppu_line_regs *regs,
+                             const obj_attrs *obj,
+                             int row,
+                             int start,
+                             int end,
+                             scanline_layers *layers)
+{
+    if (obj->vflip)
+        row = obj->height - 1 - row;
+
+    int tiles_wide = obj->width / TILE_PX_SIDE_LENGTH;
+    uint32_t tile_step = obj->eight_bit_color ? 2 : 1;
+    uint32_t row_start = obj->tileno + obj_tile_row_stride(regs, obj)*(row / 8);
+    uint8_t buf[TILE_PX_SIDE_LENGTH];
+
+    for (int col = 0; col < tiles_wide; ++col)
+    {
+        int x = obj->x + TILE_PX_SIDE_LENGTH*col;
+        if (x >= end || x + TILE_PX_SIDE_LENGTH <= start)
+            continue;
+
+        int tile_col = obj->hflip ? tiles_wide - 1 - col : col;
+        const uint8_t *px = fetch_obj_tile_row(ctx, obj, row_start + tile_step*tile_col, row % 8, buf);
+
+        for (int i = 0; i < TILE_PX_SIDE_LENGTH; ++i)
+        {
+            uint8_t idx = px[obj->hflip ? 7 - i : i];
+            if (idx && x + i >= start && x + i < end)
+                draw_obj_pixel(layers, obj, x + i, idx);
+        }
+    }
+}
+
+static void draw_affine_obj(ppu_render_ctx *ctx,
+                            const ppu_line_regs *regs,
+                            const obj_attrs *obj,
+                            int row,
+                            int start,
+                            int end,
+                            scanline_layers *layers)
+{
+    const int16_t *matrix = ctx->obj_matrices[obj->matrix];
+    int32_t pa = matrix[0];
+    int32_t pb = matrix[1];
+    int32_t pc = matrix[2];
+    int32_t pd = matrix[3];
+
+    // rotate around the center of the OBJ, in 8.8 fixed point
+    int32_t ix = -(obj->box_width / 2);
+    int32_t iy = row - obj->box_height / 2;
+    int32_t tx = pa*ix + pb*iy + ((obj->width / 2) << 8);
+    int32_t ty = pc*ix + pd*iy + ((obj->height / 2) << 8);
+    uint32_t row_stride = obj_tile_row_stride(regs, obj);
+
+    // only the part of the OBJ inside the span
+    int first = start - obj->x > 0 ? start - obj->x : 0;
+    int last = end - obj->x < obj->box_width ? end - obj->x : obj->box_width;
+    tx += first*pa;
+    ty += first*pc;
+
+    for (int i = first; i < last; ++i, tx += pa, ty += pc)
+    {
+        int x = obj->x + i;
+        int texel_x = tx >> 8;
+        int texel_y = ty >> 8;
+
+        if ((unsigned)texel_x >= obj->width || (unsigned)texel_y >= obj->height)
+            continue;
+
+        uint8_t idx = fetch_obj_texel(ctx, obj, row_stride, texel_x, texel_y);
+        if (idx)
+            draw_obj_pixel(layers, obj, x, idx);
+    }
+}
+
+void render_objects(ppu_render_ctx *ctx,
+                    const ppu_line_regs *regs,
+                    int start,
+                    int end,
+                    scanline_layers *layers)
+{
+    memset(layers->obj, 0, SCANLINE_BUF_WIDTH);
+    memset(layers->obj_prio, 0, SCANLINE_BUF_WIDTH);
+    memset(layers->obj_flags, 0, SCANLINE_BUF_WIDTH);
+
+    if (ctx->oam_dirty)
+        decode_oam(ctx);
+
+    // the first 512 OBJ tiles overlap the frame buffers of the bitmap modes
+    bool bitmap_mode = (regs->dispcnt & 0x7) >= 3;
+
+    const uint8_t *objnos = ctx->line_objs[regs->vcount];
+    int count = ctx->line_obj_counts[regs->vcount];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const obj_attrs *obj = &ctx->objs[objnos[i]];
+        int row = (uint8_t)(regs->vcount - obj->y);
+
+        if (bitmap_mode && obj->tileno < 512)
+            continue;
+
+        if (obj->affine)
+            draw_affine_obj(ctx, regs, obj, row, start, end, layers);
+        else
+            draw_regular_obj(ctx, regs, obj, row, start, end, layers);
+    }
+}
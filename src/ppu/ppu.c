@@ -0,0 +1,333 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/backend.h"
+#include "cgba/interrupt.h"
+#include "cgba/memory.h"
+#include "cgba/ppu.h"
+#include "render.h"
+
+#define CLOCKS_PER_DOT 4
+
+#define HBLANK_START (CLOCKS_PER_DOT*240)
+#define SCANLINE_END (CLOCKS_PER_DOT*308)
+
+#define VBLANK_START  160 /* scanline start for vblank */
+#define VBLANK_END    227 /* scanline end for vblank */
+#define NUM_SCANLINES 228
+
+gba_ppu *init_ppu(void)
+{
+    gba_ppu *ppu = malloc(sizeof(gba_ppu));
+    if (ppu == NULL)
+        return NULL;
+
+    memset(ppu, 0, sizeof(gba_ppu));
+
+    ppu->dispcnt = 0x0080; // force blank -> all white lines drawn
+    ppu->dispstat = 0;
+    ppu->vcount = 0;
+    ppu->scanline_clock = 0;
+    ppu->curr_frame_rendered = false;
+    ppu->color_correction = false;
+
+    // identity matrices for BG2 and BG3, as left by the BIOS
+    for (int i = 0; i < 2; ++i)
+    {
+        ppu->bgpa[i] = 0x100;
+        ppu->bgpd[i] = 0x100;
+    }
+
+    ppu->render_ctx = init_render_ctx(ppu->frame_buffer);
+    if (ppu->render_ctx == NULL)
+    {
+        free(ppu);
+        return NULL;
+    }
+
+    // white screen on startup
+    for (size_t i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; ++i)
+        ppu->frame_buffer[i] = WHITE;
+
+    return ppu;
+}
+
+void deinit_ppu(gba_ppu *ppu)
+{
+    if (ppu->render_thread != NULL)
+        stop_render_thread(ppu->render_thread);
+
+    deinit_render_ctx(ppu->render_ctx);
+    free(ppu);
+}
+
+int enable_render_thread(gba_ppu *ppu)
+{
+    if (ppu->render_thread != NULL)
+        return 0;
+
+    ppu->render_thread = start_render_thread(ppu->render_ctx, ppu);
+    if (ppu->render_thread == NULL)
+        return -1;
+
+    // the render thread took a full copy of display memory
+    memset(ppu->vram_dirty, 0, sizeof ppu->vram_dirty);
+    memset(ppu->palette_dirty, 0, sizeof ppu->palette_dirty);
+    ppu->vram_written = false;
+    ppu->palette_written = false;
+    ppu->oam_written = false;
+
+    return 0;
+}
+
+void mark_vram_dirty(gba_ppu *ppu, uint32_t offset)
+{
+    uint32_t tileno = offset / TILE_4BPP_SIZE;
+    ppu->vram_dirty[tileno / 32] |= 1u << (tileno % 32);
+    ppu->vram_written = true;
+}
+
+void mark_palette_dirty(gba_ppu *ppu, uint32_t offset)
+{
+    uint32_t colorno = (offset & PRAM_MASK) / 2;
+    ppu->palette_dirty[colorno / 32] |= 1u << (colorno % 32);
+    ppu->palette_written = true;
+}
+
+void mark_oam_dirty(gba_ppu *ppu)
+{
+    ppu->oam_written = true;
+}
+
+void mark_display_memory_dirty(gba_ppu *ppu)
+{
+    memset(ppu->vram_dirty, 0xff, sizeof ppu->vram_dirty);
+    memset(ppu->palette_dirty, 0xff, sizeof ppu->palette_dirty);
+    ppu->vram_written = true;
+    ppu->palette_written = true;
+    ppu->oam_written = true;
+}
+
+// sign extend a 28-bit reference point register
+static inline int32_t reference_point(uint32_t reg)
+{
+    return (int32_t)(reg << 4) >> 4;
+}
+
+void reload_bg_reference_x(gba_ppu *ppu, int affno)
+{
+    ppu->bgx_internal[affno] = reference_point(ppu->bgx[affno]);
+}
+
+void reload_bg_reference_y(gba_ppu *ppu, int affno)
+{
+    ppu->bgy_internal[affno] = reference_point(ppu->bgy[affno]);
+}
+
+static void render_frame(gba_ppu *ppu)
+{
+    bool *line_changed = ppu->render_ctx->line_changed;
+
+    if (ppu->backend != NULL)
+        ppu->backend->present_frame(ppu->backend, ppu->frame_buffer, line_changed);
+
+    memset(line_changed, 0, FRAME_HEIGHT * sizeof(bool));
+    ppu->frame_presented_signal = true;
+}
+
+static void latch_line_regs(gba_ppu *ppu, ppu_line_regs *regs)
+{
+    regs->vcount = ppu->vcount;
+    regs->dispcnt = ppu->dispcnt;
+    regs->bgcnt[0] = ppu->bg0cnt;
+    regs->bgcnt[1] = ppu->bg1cnt;
+    regs->bgcnt[2] = ppu->bg2cnt;
+    regs->bgcnt[3] = ppu->bg3cnt;
+    memcpy(regs->bghoffsets, ppu->bghoffsets, sizeof regs->bghoffsets);
+    memcpy(regs->bgvoffsets, ppu->bgvoffsets, sizeof regs->bgvoffsets);
+
+    memcpy(regs->winh, ppu->winh, sizeof regs->winh);
+    memcpy(regs->winv, ppu->winv, sizeof regs->winv);
+    for (int i = 0; i < 2; ++i)
+    {
+        regs->bgpa[i] = ppu->bgpa[i];
+        regs->bgpc[i] = ppu->bgpc[i];
+        regs->bgx[i] = ppu->bgx_internal[i];
+        regs->bgy[i] = ppu->bgy_internal[i];
+    }
+
+    regs->winin = ppu->winin;
+    regs->winout = ppu->winout;
+
+    regs->bldcnt = ppu->bldcnt;
+    regs->bldalpha = ppu->bldalpha;
+    regs->bldy = ppu->bldy;
+
+    regs->color_correction = ppu->color_correction;
+}
+
+/* Hand the display memory written since the last scanline
+ * to the render context when drawing on this thread
+ */
+static void forward_display_memory(gba_ppu *ppu)
+{
+    ppu_render_ctx *ctx = ppu->render_ctx;
+
+    ctx->vram = ppu->vram;
+    ctx->palette_ram = ppu->palette_ram;
+    ctx->oam = ppu->oam;
+
+    if (ppu->vram_written)
+    {
+        for (int i = 0; i < VRAM_NUM_TILES / 32; ++i)
+            ctx->tile_dirty[i] |= ppu->vram_dirty[i];
+
+        memset(ppu->vram_dirty, 0, sizeof ppu->vram_dirty);
+        ppu->vram_written = false;
+    }
+
+    if (ppu->palette_written)
+    {
+        for (int i = 0; i < PALETTE_NUM_COLORS / 32; ++i)
+            ctx->palette_dirty[i] |= ppu->palette_dirty[i];
+
+        memset(ppu->palette_dirty, 0, sizeof ppu->palette_dirty);
+        ppu->palette_written = false;
+    }
+
+    if (ppu->oam_written)
+    {
+        ctx->oam_dirty = true;
+        ppu->oam_written = false;
+    }
+}
+
+/* Draw the current scanline from where drawing last left off up to the
+ * given pixel, with the registers and display memory as they are now
+ */
+static void draw_scanline_up_to(gba_ppu *ppu, int end)
+{
+    ppu_line_regs regs;
+    latch_line_regs(ppu, &regs);
+
+    if (ppu->render_thread != NULL)
+    {
+        submit_scanline(ppu->render_thread, ppu, &regs, ppu->line_px_drawn, end);
+    }
+    else
+    {
+        forward_display_memory(ppu);
+        draw_scanline(ppu->render_ctx, &regs, ppu->line_px_drawn, end);
+    }
+
+    ppu->line_px_drawn = end;
+}
+
+void catch_up_scanline(gba_ppu *ppu)
+{
+    if (ppu->skip_frame)
+        return;
+
+    // HBlank and VBlank writes are seen from the next scanline on
+    if (ppu->vcount >= VBLANK_START || ppu->scanline_clock >= HBLANK_START)
+        return;
+
+    int px = ppu->scanline_clock / CLOCKS_PER_DOT;
+    if (px > ppu->line_px_drawn)
+        draw_scanline_up_to(ppu, px);
+}
+
+static void render_scanline(gba_ppu *ppu)
+{
+    if (!ppu->skip_frame)
+        draw_scanline_up_to(ppu, FRAME_WIDTH);
+
+    // move the affine BGs' reference points down one line
+    for (int i = 0; i < 2; ++i)
+    {
+        ppu->bgx_internal[i] += (int16_t)ppu->bgpb[i];
+        ppu->bgy_internal[i] += (int16_t)ppu->bgpd[i];
+    }
+}
+
+// Called on entering HBlank, including during VBlank scanlines
+static void enter_hblank(gba_ppu *ppu)
+{
+    ppu->dispstat |= 0x2; // set HBlank flag
+
+    if (ppu->dispstat & (1 << 4))
+        ppu->mem->irq_request |= IRQ_HBLANK;
+
+    if (ppu->vcount < VBLANK_START)
+        render_scanline(ppu);
+}
+
+static void enter_vblank(gba_ppu *ppu)
+{
+    ppu->dispstat |= 0x1; // VBlank flag
+    if (ppu->dispstat & (1 << 3))
+        ppu->mem->irq_request |= IRQ_VBLANK;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        reload_bg_reference_x(ppu, i);
+        reload_bg_reference_y(ppu, i);
+    }
+
+    // a skipped frame still counts as a frame for input and throttling
+    if (ppu->skip_frame)
+    {
+        ppu->frame_presented_signal = true;
+        return;
+    }
+
+    // the frame buffer is complete once every scanline has been drawn
+    if (ppu->render_thread != NULL)
+        wait_render_thread_idle(ppu->render_thread);
+
+    render_frame(ppu);
+}
+
+static void update_vcount(gba_ppu *ppu)
+{
+    ppu->scanline_clock = 0;
+    ppu->line_px_drawn = 0;
+    ppu->dispstat &= ~0x2; // unset HBlank flag
+    ppu->vcount = (ppu->vcount + 1) % NUM_SCANLINES;
+
+    uint8_t lyc = ppu->dispstat >> 8;
+    if (lyc == ppu->vcount)
+    {
+        ppu->dispstat |= 0x4; // V-Counter flag
+        if (ppu->dispstat & (1 << 5))
+            ppu->mem->irq_request |= IRQ_VCOUNT;
+    }
+    else
+    {
+        ppu->dispstat &= ~0x4;
+    }
+}
+
+void run_ppu(gba_ppu *ppu, int num_clocks)
+{
+    for (; num_clocks; --num_clocks)
+    {
+        ++ppu->scanline_clock;
+
+        if (ppu->scanline_clock == HBLANK_START)
+            enter_hblank(ppu);
+        else if (ppu->scanline_clock == SCANLINE_END)
+            update_vcount(ppu);
+
+        // beginning of new scanline
+        if (!ppu->scanline_clock)
+        {
+            // VBlank is scanlines 160..226 (not 227)
+            if (ppu->vcount == VBLANK_START)
+                enter_vblank(ppu);
+            else if (ppu->vcount == VBLANK_END)
+                ppu->dispstat &= ~0x1;
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/error.h"
+#include "cgba/ppu.h"
+#include "render.h"
+
+ppu_render_ctx *init_render_ctx(uint32_t *frame_buffer)
+{
+    ppu_render_ctx *ctx = malloc(sizeof(ppu_render_ctx));
+    if (ctx == NULL)
+        return NULL;
+
+    memset(ctx, 0, sizeof(ppu_render_ctx));
+
+    // decode every tile and convert every color on first use
+    memset(ctx->tile_dirty, 0xff, sizeof ctx->tile_dirty);
+    memset(ctx->palette_dirty, 0xff, sizeof ctx->palette_dirty);
+    ctx->color_correction = false;
+    ctx->oam_dirty = true;
+
+    ctx->frame_buffer = frame_buffer;
+
+    return ctx;
+}
+
+void deinit_render_ctx(ppu_render_ctx *ctx)
+{
+    free(ctx);
+}
+
+enum BG_TYPE {
+    BG_NONE,
+    BG_TEXT,
+    BG_AFFINE,
+};
+
+/* The kind of each BG in the tiled modes 0-2 */
+static const enum BG_TYPE tiled_mode_bgs[3][4] = {
+    {BG_TEXT, BG_TEXT, BG_TEXT,   BG_TEXT},
+    {BG_TEXT, BG_TEXT, BG_AFFINE, BG_NONE},
+    {BG_NONE, BG_NONE, BG_AFFINE, BG_AFFINE},
+};
+
+static void render_tiled_scanline(ppu_render_ctx *ctx,
+                                  const ppu_line_regs *regs,
+                                  int mode,
+                                  int start,
+                                  int end,
+                                  uint32_t *line)
+{
+    scanline_layers layers;
+    layers.bg2_direct = false;
+
+    for (int bgno = PPU_BG0; bgno <= PPU_BG3; ++bgno)
+    {
+        enum BG_TYPE type = tiled_mode_bgs[mode][bgno];
+        layers.bg_enabled[bgno] = type != BG_NONE && (regs->dispcnt & (1 << (8 + bgno)));
+        if (!layers.bg_enabled[bgno])
+            continue;
+
+        if (type == BG_TEXT)
+            render_text_background(ctx, regs, bgno, start, end, layers.bg[bgno]);
+        else
+            render_affine_background(ctx, regs, bgno, start, end, layers.bg[bgno]);
+
+        // the compositor works on whole vectors, which can reach outside the span
+        memset(layers.bg[bgno], 0, start);
+        memset(layers.bg[bgno] + end, 0, SCANLINE_BUF_WIDTH - end);
+    }
+
+    layers.obj_enabled = regs->dispcnt & (1 << 12);
+    if (layers.obj_enabled)
+        render_objects(ctx, regs, start, end, &layers);
+
+    compose_scanline(ctx, regs, &layers, start, end, line);
+}
+
+/* Draw pixels [start, end) of a scanline into the same pixels of line */
+static void render_scanline(ppu_render_ctx *ctx,
+                            const ppu_line_regs *regs,
+                            int start,
+                            int end,
+                            uint32_t *line)
+{
+    if (regs->dispcnt & (1 << 7)) // forced blank
+    {
+        for (int i = start; i < end; ++i)
+            line[i] = WHITE;
+        return;
+    }
+
+    // every cached color needs converting again
+    if (regs->color_correction != ctx->color_correction)
+    {
+        ctx->color_correction = regs->color_correction;
+        memset(ctx->palette_dirty, 0xff, sizeof ctx->palette_dirty);
+    }
+
+    refresh_palette_cache(ctx);
+
+    int mode = regs->dispcnt & 0x7;
+    switch (mode)
+    {
+        case 0x0:
+        case 0x1:
+        case 0x2:
+            render_tiled_scanline(ctx, regs, mode, start, end, line);
+            break;
+
+        case 0x3:
+        case 0x4:
+        case 0x5:
+            render_bitmap_scanline(ctx, regs, mode, start, end, line);
+            break;
+
+        default:
+            fatal_error("Error: Unimplemented BG mode: %d\n",
+                        mode);
+    }
+}
+
+void draw_scanline(ppu_render_ctx *ctx, const ppu_line_regs *regs, int start, int end)
+{
+    uint32_t *line = ctx->frame_buffer + FRAME_WIDTH * regs->vcount;
+    uint32_t new_line[FRAME_WIDTH];
+
+    // Only the span is drawn, so a line split by mid-line writes costs
+    // about as much as drawing it once. Comparing against the last
+    // frame lets unchanged lines skip the texture upload.
+    render_scanline(ctx, regs, start, end, new_line);
+
+    size_t span_size = sizeof(uint32_t) * (end - start);
+    if (memcmp(line + start, new_line + start, span_size))
+    {
+        memcpy(line + start, new_line + start, span_size);
+        ctx->line_changed[regs->vcount] = true;
+    }
+}
@@ -0,0 +1,294 @@
+#ifndef CGBA_PPU_RENDER_H
+#define CGBA_PPU_RENDER_H
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "cgba/ppu.h"
+
+#define KB 1024
+
+#define TILE_PX_SIDE_LENGTH 8
+#define TILE_8BPP_SIZE 64
+
+/* sizes of and masks for offsets into the display memory views */
+#define PRAM_SIZE 0x400
+#define VRAM_SIZE 0x18000
+#define OAM_SIZE  0x400
+
+#define PRAM_MASK 0x3ff
+#define VRAM_MASK 0x1ffff // VRAM's 96K is mirrored every 128K
+
+/* BG tile data can't be fetched from OBJ VRAM */
+#define BG_VRAM_SIZE (64*KB)
+
+/* XRGB8888 */
+#define WHITE 0x00ffffff
+
+/* Layer buffers are padded with transparent pixels
+ * so the compositor can work on whole SIMD vectors
+ */
+#define SCANLINE_BUF_WIDTH 256
+
+/* window control bits, as laid out in WININ/WINOUT */
+#define WIN_EFFECTS (1 << 5)
+#define WIN_ALL     0x3f
+
+/* OAM holds 128 OBJs and 32 OBJ rotation/scaling matrices */
+#define NUM_OBJS 128
+#define NUM_OBJ_MATRICES 32
+
+/* OBJ tiles are in the last 32K of VRAM */
+#define OBJ_VRAM_BASE 0x10000
+#define OBJ_VRAM_MASK 0x7fff
+
+/* per-pixel OBJ attributes */
+#define OBJ_SEMI_TRANSPARENT (1 << 0)
+#define OBJ_WINDOW           (1 << 1)
+
+enum PPU_BGNO {
+    PPU_BG0,
+    PPU_BG1,
+    PPU_BG2,
+    PPU_BG3,
+};
+
+/* Layer numbers match the target bits of BLDCNT */
+enum PPU_LAYER {
+    LAYER_BG0,
+    LAYER_BG1,
+    LAYER_BG2,
+    LAYER_BG3,
+    LAYER_OBJ,
+    LAYER_BD,   // backdrop
+    LAYER_NONE, // nothing below the backdrop
+};
+
+/* An OBJ's attributes, decoded from OAM */
+typedef struct obj_attrs {
+    int16_t x;              // left edge, -256..255
+    uint8_t y;              // top edge, wrapping at the bottom of the 256 line space
+    uint8_t width;          // size of the OBJ's tiles, in pixels
+    uint8_t height;
+    uint8_t box_width;      // size of the area drawn to, doubled
+    uint8_t box_height;     // for double-size affine OBJs
+    uint8_t flags;          // OBJ_SEMI_TRANSPARENT, OBJ_WINDOW
+    uint8_t priority;
+    uint8_t palette_bank;
+    uint8_t matrix;
+    uint16_t tileno;
+    bool affine;
+    bool eight_bit_color;
+    bool hflip;
+    bool vflip;
+} obj_attrs;
+
+/* Snapshot of the registers that determine how a scanline is drawn */
+typedef struct ppu_line_regs {
+    uint8_t vcount;
+    uint16_t dispcnt;
+    uint16_t bgcnt[4];
+    uint16_t bghoffsets[4];
+    uint16_t bgvoffsets[4];
+
+    // BG2 and BG3 rotation/scaling, with the reference
+    // point stepped to the start of this scanline
+    int16_t bgpa[2];
+    int16_t bgpc[2];
+    int32_t bgx[2];
+    int32_t bgy[2];
+
+    uint16_t winh[2];
+    uint16_t winv[2];
+    uint16_t winin;
+    uint16_t winout;
+
+    uint16_t bldcnt;
+    uint16_t bldalpha;
+    uint16_t bldy;
+
+    bool color_correction;
+} ppu_line_regs;
+
+/* State needed to draw scanlines, separate from the PPU's
+ * registers and timing so it can be owned by a render thread
+ */
+struct ppu_render_ctx {
+    // display memory being drawn from
+    const uint8_t *vram;
+    const uint8_t *palette_ram;
+    const uint8_t *oam;
+
+    // 4bpp tiles expanded to one palette index per pixel, and a bitmap
+    // of the tiles whose VRAM has been written since they were decoded
+    uint8_t tile_cache[VRAM_NUM_TILES][2*TILE_4BPP_SIZE];
+    uint32_t tile_dirty[VRAM_NUM_TILES / 32];
+
+    // palette RAM converted to the frame buffer's color format, and a
+    // bitmap of the colors written since they were last converted
+    uint32_t palette_cache[PALETTE_NUM_COLORS];
+    uint32_t palette_dirty[PALETTE_NUM_COLORS / 32];
+    bool color_correction;
+
+    // the visible OBJs decoded from OAM, the OAM indices of the OBJs on
+    // each scanline in priority order, and whether OAM has been written
+    // since it was decoded
+    obj_attrs objs[NUM_OBJS];
+    int16_t obj_matrices[NUM_OBJ_MATRICES][4]; // PA, PB, PC, PD
+    uint8_t line_objs[FRAME_HEIGHT][NUM_OBJS];
+    uint8_t line_obj_counts[FRAME_HEIGHT];
+    bool oam_dirty;
+
+    uint32_t *frame_buffer;
+
+    // scanlines of the frame buffer changed since the frame was last presented
+    bool line_changed[FRAME_HEIGHT];
+};
+
+typedef struct scanline_layers {
+    // palette index of each pixel, 0 = transparent
+    alignas(32) uint8_t bg[4][SCANLINE_BUF_WIDTH];
+    alignas(32) uint8_t obj[SCANLINE_BUF_WIDTH];
+
+    // priority and OBJ_* attributes of each OBJ pixel
+    alignas(32) uint8_t obj_prio[SCANLINE_BUF_WIDTH];
+    alignas(32) uint8_t obj_flags[SCANLINE_BUF_WIDTH];
+
+    // XBGR1555 colors of BG2 in the direct color bitmap modes, where
+    // bg[PPU_BG2] only tells which pixels are opaque
+    alignas(32) uint16_t bg2_colors[SCANLINE_BUF_WIDTH];
+    bool bg2_direct;
+
+    // layers that have been drawn into the buffers
+    bool bg_enabled[4];
+    bool obj_enabled;
+} scanline_layers;
+
+/* Fold an offset into VRAM as the memory bus does: the last 32K
+ * of each 128K mirrors the 32K before it
+ */
+static inline uint32_t vram_offset(uint32_t offset)
+{
+    offset &= VRAM_MASK;
+    if (offset >= VRAM_SIZE)
+        offset -= 0x8000;
+
+    return offset;
+}
+
+static inline uint8_t vram_byte(ppu_render_ctx *ctx, uint32_t offset)
+{
+    return ctx->vram[vram_offset(offset)];
+}
+
+static inline uint16_t vram_halfword(ppu_render_ctx *ctx, uint32_t offset)
+{
+    const uint8_t *px = ctx->vram + vram_offset(offset & ~0x1u);
+    return px[0] | px[1] << 8;
+}
+
+static inline uint16_t pram_halfword(ppu_render_ctx *ctx, uint32_t offset)
+{
+    const uint8_t *px = ctx->palette_ram + (offset & PRAM_MASK & ~0x1u);
+    return px[0] | px[1] << 8;
+}
+
+static inline uint16_t oam_halfword(ppu_render_ctx *ctx, uint32_t offset)
+{
+    const uint8_t *attr = ctx->oam + (offset & (OAM_SIZE - 1) & ~0x1u);
+    return attr[0] | attr[1] << 8;
+}
+
+/* Create a render context that draws into the given frame buffer */
+ppu_render_ctx *init_render_ctx(uint32_t *frame_buffer);
+void deinit_render_ctx(ppu_render_ctx *ctx);
+
+/* Draw pixels [start, end) of the scanline described by the register snapshot */
+void draw_scanline(ppu_render_ctx *ctx, const ppu_line_regs *regs, int start, int end);
+
+/* Draw a text BG's palette indices for pixels [start, end) of the current scanline */
+void render_text_background(ppu_render_ctx *ctx,
+                            const ppu_line_regs *regs,
+                            enum PPU_BGNO bgno,
+                            int start,
+                            int end,
+                            uint8_t *px_palette_idxs);
+
+/* Expand a 4bpp tile into one palette index per pixel */
+void decode_tile(ppu_render_ctx *ctx, uint32_t tileno);
+
+/* A 4bpp tile as one palette index per pixel, decoded if it has been written */
+static inline const uint8_t *fetch_decoded_tile(ppu_render_ctx *ctx, uint32_t tileno)
+{
+    if (ctx->tile_dirty[tileno / 32] & (1u << (tileno % 32)))
+        decode_tile(ctx, tileno);
+
+    return ctx->tile_cache[tileno];
+}
+
+/* Draw the OBJs on pixels [start, end) of the current scanline into
+ * the OBJ layer, which is transparent everywhere else
+ */
+void render_objects(ppu_render_ctx *ctx,
+                    const ppu_line_regs *regs,
+                    int start,
+                    int end,
+                    scanline_layers *layers);
+
+/* Draw pixels [start, end) of a scanline of the bitmap modes 3-5 */
+void render_bitmap_scanline(ppu_render_ctx *ctx,
+                            const ppu_line_regs *regs,
+                            int mode,
+                            int start,
+                            int end,
+                            uint32_t *line);
+
+/* Draw a rotation/scaling BG's palette indices for pixels
+ * [start, end) of the current scanline
+ */
+void render_affine_background(ppu_render_ctx *ctx,
+                              const ppu_line_regs *regs,
+                              enum PPU_BGNO bgno,
+                              int start,
+                              int end,
+                              uint8_t *px_palette_idxs);
+
+/* Convert an XBGR1555 color to the frame buffer's XRGB8888 format */
+uint32_t convert_color(ppu_render_ctx *ctx, uint16_t color);
+
+/* Bring the converted palette up to date with palette RAM */
+void refresh_palette_cache(ppu_render_ctx *ctx);
+
+/* Resolve pixels [start, end) of the drawn layers into final
+ * colors by priority, windows, and color special effects
+ */
+void compose_scanline(ppu_render_ctx *ctx,
+                      const ppu_line_regs *regs,
+                      scanline_layers *layers,
+                      int start,
+                      int end,
+                      uint32_t *line);
+
+/* Start a thread that draws the scanlines submitted to it */
+ppu_render_thread *start_render_thread(ppu_render_ctx *ctx, const gba_ppu *ppu);
+
+/* Wait for every submitted scanline to be drawn, then stop the thread */
+void stop_render_thread(ppu_render_thread *rt);
+
+/* Queue pixels [start, end) of a scanline to be drawn, along with whichever
+ * display memory has been written since the last scanline was submitted.
+ * Like wait_render_thread_idle, raises any fatal error the render thread
+ * has run into.
+ */
+void submit_scanline(ppu_render_thread *rt,
+                     gba_ppu *ppu,
+                     const ppu_line_regs *regs,
+                     int start,
+                     int end);
+
+/* Wait for every submitted scanline to be drawn, then raise any fatal
+ * error drawing them ran into with fatal_error on the calling thread
+ */
+void wait_render_thread_idle(ppu_render_thread *rt);
+
+#endif /* CGBA_PPU_RENDER_H */
@@ -0,0 +1,319 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/error.h"
+#include "cgba/ppu.h"
+#include "render.h"
+
+/* Must be a power of two. A frame has 160 scanlines, so the
+ * emulation thread can run well ahead before having to wait.
+ */
+#define RING_SIZE 64
+
+/* Iterations to poll an atomic before going to sleep on it */
+#define SPIN_COUNT 4096
+
+/* Everything needed to draw one scanline. Palette RAM and OAM are
+ * small enough to travel with the scanline when they have changed.
+ */
+typedef struct render_job {
+    ppu_line_regs regs;
+    int start;
+    int end;
+
+    bool palette_written;
+    bool oam_written;
+    uint32_t palette_dirty[PALETTE_NUM_COLORS / 32];
+    uint8_t palette_ram[PRAM_SIZE];
+    uint8_t oam[OAM_SIZE];
+} render_job;
+
+struct ppu_render_thread {
+    ppu_render_ctx *ctx;
+    pthread_t thread;
+
+    // single producer (emulation thread), single consumer (render thread)
+    render_job jobs[RING_SIZE];
+    atomic_uint head; // next job to be submitted
+    atomic_uint tail; // next job to be drawn
+
+    // used only to sleep when one side has to wait for the other
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t work_done;
+    atomic_bool worker_sleeping;
+    atomic_bool producer_waiting;
+    atomic_bool quit;
+
+    // a fatal error while drawing, raised again on the emulation thread
+    atomic_bool failed;
+    char error_message[256];
+
+    // the render thread's copy of display memory
+    uint8_t vram[VRAM_SIZE];
+    uint8_t palette_ram[PRAM_SIZE];
+    uint8_t oam[OAM_SIZE];
+};
+
+static void wake(ppu_render_thread *rt, atomic_bool *sleeping, pthread_cond_t *cond)
+{
+    if (atomic_load(sleeping))
+    {
+        pthread_mutex_lock(&rt->lock);
+        pthread_cond_signal(cond);
+        pthread_mutex_unlock(&rt->lock);
+    }
+}
+
+/* Wait until the render thread has no more than max_pending jobs left */
+static void wait_for_jobs(ppu_render_thread *rt, unsigned max_pending)
+{
+    unsigned head = atomic_load(&rt->head);
+
+    for (int i = 0; i < SPIN_COUNT; ++i)
+    {
+        if (head - atomic_load(&rt->tail) <= max_pending)
+            return;
+    }
+
+    pthread_mutex_lock(&rt->lock);
+    atomic_store(&rt->producer_waiting, true);
+    while (head - atomic_load(&rt->tail) > max_pending)
+        pthread_cond_wait(&rt->work_done, &rt->lock);
+    atomic_store(&rt->producer_waiting, false);
+    pthread_mutex_unlock(&rt->lock);
+}
+
+/* Wait for a job to be submitted. Returns false once the thread should quit. */
+static bool wait_for_work(ppu_render_thread *rt, unsigned tail)
+{
+    for (int i = 0; i < SPIN_COUNT; ++i)
+    {
+        if (atomic_load(&rt->head) != tail)
+            return true;
+    }
+
+    pthread_mutex_lock(&rt->lock);
+    atomic_store(&rt->worker_sleeping, true);
+    while (atomic_load(&rt->head) == tail && !atomic_load(&rt->quit))
+        pthread_cond_wait(&rt->work_available, &rt->lock);
+    atomic_store(&rt->worker_sleeping, false);
+    pthread_mutex_unlock(&rt->lock);
+
+    return atomic_load(&rt->head) != tail;
+}
+
+/* Mark the current job as drawn */
+static void finish_job(ppu_render_thread *rt)
+{
+    atomic_fetch_add(&rt->tail, 1);
+    wake(rt, &rt->producer_waiting, &rt->work_done);
+}
+
+static void *render_thread_main(void *arg)
+{
+    ppu_render_thread *rt = arg;
+    ppu_render_ctx *ctx = rt->ctx;
+
+    // exiting from here would take the whole process down, so errors
+    // are handed over to the emulation thread, which can deal with them
+    jmp_buf handler;
+    if (setjmp(handler))
+    {
+        if (!atomic_load(&rt->failed))
+        {
+            snprintf(rt->error_message, sizeof rt->error_message, "%s", fatal_error_message());
+            atomic_store(&rt->failed, true);
+        }
+
+        finish_job(rt);
+    }
+
+    set_fatal_error_handler(&handler);
+
+    for (unsigned tail = atomic_load(&rt->tail); wait_for_work(rt, tail); ++tail)
+    {
+        render_job *job = &rt->jobs[tail % RING_SIZE];
+
+        if (job->palette_written)
+        {
+            memcpy(rt->palette_ram, job->palette_ram, PRAM_SIZE);
+            for (int i = 0; i < PALETTE_NUM_COLORS / 32; ++i)
+                ctx->palette_dirty[i] |= job->palette_dirty[i];
+        }
+
+        if (job->oam_written)
+        {
+            memcpy(rt->oam, job->oam, OAM_SIZE);
+            ctx->oam_dirty = true;
+        }
+
+        draw_scanline(ctx, &job->regs, job->start, job->end);
+        finish_job(rt);
+    }
+
+    set_fatal_error_handler(NULL);
+    return NULL;
+}
+
+ppu_render_thread *start_render_thread(ppu_render_ctx *ctx, const gba_ppu *ppu)
+{
+    ppu_render_thread *rt = malloc(sizeof(ppu_render_thread));
+    if (rt == NULL)
+        return NULL;
+
+    memset(rt, 0, sizeof(ppu_render_thread));
+    rt->ctx = ctx;
+    atomic_init(&rt->head, 0);
+    atomic_init(&rt->tail, 0);
+    atomic_init(&rt->worker_sleeping, false);
+    atomic_init(&rt->producer_waiting, false);
+    atomic_init(&rt->quit, false);
+    atomic_init(&rt->failed, false);
+
+    // start from a full copy of display memory; only what's
+    // written from here on has to be handed over
+    memcpy(rt->vram, ppu->vram, VRAM_SIZE);
+    memcpy(rt->palette_ram, ppu->palette_ram, PRAM_SIZE);
+    memcpy(rt->oam, ppu->oam, OAM_SIZE);
+
+    ctx->vram = rt->vram;
+    ctx->palette_ram = rt->palette_ram;
+    ctx->oam = rt->oam;
+    memset(ctx->tile_dirty, 0xff, sizeof ctx->tile_dirty);
+    memset(ctx->palette_dirty, 0xff, sizeof ctx->palette_dirty);
+    ctx->oam_dirty = true;
+
+    if (pthread_mutex_init(&rt->lock, NULL))
+        goto mutex_error;
+
+    if (pthread_cond_init(&rt->work_available, NULL))
+        goto work_available_error;
+
+    if (pthread_cond_init(&rt->work_done, NULL))
+        goto work_done_error;
+
+    if (pthread_create(&rt->thread, NULL, render_thread_main, rt))
+        goto thread_error;
+
+    return rt;
+
+thread_error:
+    pthread_cond_destroy(&rt->work_done);
+work_done_error:
+    pthread_cond_destroy(&rt->work_available);
+work_available_error:
+    pthread_mutex_destroy(&rt->lock);
+mutex_error:
+    free(rt);
+    return NULL;
+}
+
+void stop_render_thread(ppu_render_thread *rt)
+{
+    // not wait_render_thread_idle, a failed thread is still stopped
+    wait_for_jobs(rt, 0);
+
+    atomic_store(&rt->quit, true);
+    pthread_mutex_lock(&rt->lock);
+    pthread_cond_signal(&rt->work_available);
+    pthread_mutex_unlock(&rt->lock);
+    pthread_join(rt->thread, NULL);
+
+    pthread_cond_destroy(&rt->work_done);
+    pthread_cond_destroy(&rt->work_available);
+    pthread_mutex_destroy(&rt->lock);
+    free(rt);
+}
+
+/* Raise an error from the render thread on this thread */
+static void check_render_error(ppu_render_thread *rt)
+{
+    if (atomic_load(&rt->failed))
+        fatal_error("%s\n", rt->error_message);
+}
+
+void wait_render_thread_idle(ppu_render_thread *rt)
+{
+    wait_for_jobs(rt, 0);
+    check_render_error(rt);
+}
+
+/* Copy the VRAM written since the last scanline into the render thread's
+ * copy. VRAM is rarely written during active display, so rather than
+ * queueing it, this waits for the render thread to finish what it's
+ * drawing from the old contents.
+ */
+static void sync_vram(ppu_render_thread *rt, gba_ppu *ppu)
+{
+    ppu_render_ctx *ctx = rt->ctx;
+
+    wait_render_thread_idle(rt);
+
+    for (int i = 0; i < VRAM_NUM_TILES / 32; ++i)
+    {
+        uint32_t dirty = ppu->vram_dirty[i];
+        if (!dirty)
+            continue;
+
+        ctx->tile_dirty[i] |= dirty;
+        ppu->vram_dirty[i] = 0;
+
+        while (dirty)
+        {
+            uint32_t offset = TILE_4BPP_SIZE * (32*i + __builtin_ctz(dirty));
+            memcpy(rt->vram + offset, ppu->vram + offset, TILE_4BPP_SIZE);
+            dirty &= dirty - 1; // clear the least significant bit set
+        }
+    }
+
+    ppu->vram_written = false;
+}
+
+void submit_scanline(ppu_render_thread *rt,
+                     gba_ppu *ppu,
+                     const ppu_line_regs *regs,
+                     int start,
+                     int end)
+{
+    check_render_error(rt);
+
+    if (ppu->vram_written)
+        sync_vram(rt, ppu);
+
+    // wait for a free slot
+    wait_for_jobs(rt, RING_SIZE - 1);
+
+    unsigned head = atomic_load(&rt->head);
+    render_job *job = &rt->jobs[head % RING_SIZE];
+
+    job->regs = *regs;
+    job->start = start;
+    job->end = end;
+
+    job->palette_written = ppu->palette_written;
+    if (ppu->palette_written)
+    {
+        memcpy(job->palette_ram, ppu->palette_ram, PRAM_SIZE);
+        memcpy(job->palette_dirty, ppu->palette_dirty, sizeof job->palette_dirty);
+        memset(ppu->palette_dirty, 0, sizeof ppu->palette_dirty);
+        ppu->palette_written = false;
+    }
+
+    job->oam_written = ppu->oam_written;
+    if (ppu->oam_written)
+    {
+        memcpy(job->oam, ppu->oam, OAM_SIZE);
+        ppu->oam_written = false;
+    }
+
+    atomic_store(&rt->head, head + 1);
+    wake(rt, &rt->worker_sleeping, &rt->work_available);
+}
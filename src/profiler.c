@@ -0,0 +1,476 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/cpu.h"
+#include "cgba/profiler.h"
+
+#define INITIAL_SAMPLE_SLOTS 4096
+
+/* ELF constants, since <elf.h> isn't everywhere */
+#define ELF_HEADER_SIZE 52
+#define ELF_SECTION_HEADER_SIZE 40
+#define ELF_SYMBOL_SIZE 16
+#define ELF_SHT_SYMTAB 2
+#define ELF_STT_NOTYPE 0
+#define ELF_STT_FUNC 2
+
+/* Number of times the PC was sampled at an address. Addresses are
+ * halfword aligned, so address | 1 is never 0, which marks free slots.
+ */
+typedef struct pc_sample {
+    uint32_t key;
+    uint64_t count;
+} pc_sample;
+
+typedef struct profile_symbol {
+    uint32_t addr;
+    uint32_t size; // 0 if unknown, when it runs up to the next symbol
+    char *name;
+} profile_symbol;
+
+struct gba_profiler {
+    int interval;
+    int cycles_until_sample;
+    uint64_t total_samples;
+
+    // open addressing hash table of sampled addresses
+    pc_sample *samples;
+    size_t num_slots;
+    size_t num_used;
+
+    // sorted by address
+    profile_symbol *symbols;
+    size_t num_symbols;
+};
+
+gba_profiler *create_profiler(int interval)
+{
+    gba_profiler *profiler = malloc(sizeof(gba_profiler));
+    if (profiler == NULL)
+        return NULL;
+
+    profiler->samples = calloc(INITIAL_SAMPLE_SLOTS, sizeof(pc_sample));
+    if (profiler->samples == NULL)
+    {
+        free(profiler);
+        return NULL;
+    }
+
+    profiler->interval = interval;
+    profiler->cycles_until_sample = interval;
+    profiler->total_samples = 0;
+    profiler->num_slots = INITIAL_SAMPLE_SLOTS;
+    profiler->num_used = 0;
+    profiler->symbols = NULL;
+    profiler->num_symbols = 0;
+
+    return profiler;
+}
+
+static void free_symbols(gba_profiler *profiler)
+{
+    for (size_t i = 0; i < profiler->num_symbols; ++i)
+        free(profiler->symbols[i].name);
+
+    free(profiler->symbols);
+    profiler->symbols = NULL;
+    profiler->num_symbols = 0;
+}
+
+void destroy_profiler(gba_profiler *profiler)
+{
+    if (profiler == NULL)
+        return;
+
+    free_symbols(profiler);
+    free(profiler->samples);
+    free(profiler);
+}
+
+static size_t slot_of(uint32_t key, size_t num_slots)
+{
+    // Fibonacci hashing, since nearby addresses are sampled together
+    return (uint32_t)(key * 2654435769u) & (num_slots - 1);
+}
+
+static pc_sample *find_slot(pc_sample *samples, size_t num_slots, uint32_t key)
+{
+    size_t i = slot_of(key, num_slots);
+    while (samples[i].key != 0 && samples[i].key != key)
+        i = (i + 1) & (num_slots - 1);
+
+    return &samples[i];
+}
+
+/* Double the table. If there's no memory for it, the table stays as is
+ * and fills up further, which only slows it down until it's full.
+ */
+static void grow_samples(gba_profiler *profiler)
+{
+    size_t num_slots = profiler->num_slots * 2;
+    pc_sample *samples = calloc(num_slots, sizeof(pc_sample));
+    if (samples == NULL)
+        return;
+
+    for (size_t i = 0; i < profiler->num_slots; ++i)
+    {
+        if (profiler->samples[i].key != 0)
+            *find_slot(samples, num_slots, profiler->samples[i].key) = profiler->samples[i];
+    }
+
+    free(profiler->samples);
+    profiler->samples = samples;
+    profiler->num_slots = num_slots;
+}
+
+static void take_sample(gba_profiler *profiler, const arm7tdmi *cpu)
+{
+    // R15 is two instructions past the next one to run
+    bool thumb = cpu->cpsr & THUMB_ENABLE;
+    uint32_t pc = cpu->registers[R15] - (thumb ? 4 : 8);
+    uint32_t key = pc | 1;
+
+    ++profiler->total_samples;
+
+    pc_sample *sample = find_slot(profiler->samples, profiler->num_slots, key);
+    if (sample->key == 0)
+    {
+        // keep at least a quarter free, or drop the sample if full
+        if (profiler->num_used + 1 > profiler->num_slots * 3 / 4)
+        {
+            grow_samples(profiler);
+            sample = find_slot(profiler->samples, profiler->num_slots, key);
+            if (profiler->num_used + 1 == profiler->num_slots)
+                return;
+        }
+
+        sample->key = key;
+        ++profiler->num_used;
+    }
+
+    ++sample->count;
+}
+
+void profile_cycles(gba_profiler *profiler, const arm7tdmi *cpu, int num_clocks)
+{
+    profiler->cycles_until_sample -= num_clocks;
+    if (profiler->cycles_until_sample > 0)
+        return;
+
+    profiler->cycles_until_sample += profiler->interval;
+    take_sample(profiler, cpu);
+}
+
+static int add_symbol(gba_profiler *profiler, size_t *capacity, uint32_t addr, uint32_t size, const char *name)
+{
+    if (profiler->num_symbols == *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 256;
+        profile_symbol *symbols = realloc(profiler->symbols, new_capacity * sizeof(profile_symbol));
+        if (symbols == NULL)
+            return -1;
+
+        profiler->symbols = symbols;
+        *capacity = new_capacity;
+    }
+
+    char *name_copy = malloc(strlen(name) + 1);
+    if (name_copy == NULL)
+        return -1;
+
+    strcpy(name_copy, name);
+    profiler->symbols[profiler->num_symbols++] = (profile_symbol){addr, size, name_copy};
+    return 0;
+}
+
+static uint16_t read_le16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Add the functions in the symbol tables of a 32-bit little endian
+ * ELF file. Returns -1 if it's malformed or out of memory.
+ */
+static int load_elf_symbols(gba_profiler *profiler, const uint8_t *elf, size_t elf_size)
+{
+    size_t capacity = 0;
+
+    if (elf_size < ELF_HEADER_SIZE || elf[4] != 1 || elf[5] != 1) // ELFCLASS32, little endian
+        return -1;
+
+    uint32_t shoff = read_le32(elf + 32);
+    uint16_t shentsize = read_le16(elf + 46);
+    uint16_t shnum = read_le16(elf + 48);
+    if (shentsize < ELF_SECTION_HEADER_SIZE || shoff > elf_size || (size_t)shnum * shentsize > elf_size - shoff)
+        return -1;
+
+    for (int i = 0; i < shnum; ++i)
+    {
+        const uint8_t *section = elf + shoff + (size_t)i * shentsize;
+        if (read_le32(section + 4) != ELF_SHT_SYMTAB)
+            continue;
+
+        uint32_t offset = read_le32(section + 16);
+        uint32_t size = read_le32(section + 20);
+        uint32_t link = read_le32(section + 24);
+        if (link >= shnum || offset > elf_size || size > elf_size - offset)
+            return -1;
+
+        // the string table names are in
+        const uint8_t *strtab_section = elf + shoff + (size_t)link * shentsize;
+        uint32_t strtab_offset = read_le32(strtab_section + 16);
+        uint32_t strtab_size = read_le32(strtab_section + 20);
+        if (strtab_offset > elf_size || strtab_size > elf_size - strtab_offset || strtab_size == 0)
+            return -1;
+
+        const char *strtab = (const char *)elf + strtab_offset;
+        if (strtab[strtab_size - 1] != '\0')
+            return -1;
+
+        for (uint32_t j = 0; j + ELF_SYMBOL_SIZE <= size; j += ELF_SYMBOL_SIZE)
+        {
+            const uint8_t *symbol = elf + offset + j;
+            uint32_t name = read_le32(symbol);
+            int type = symbol[12] & 0xf;
+            bool defined = read_le16(symbol + 14) != 0;
+
+            if (!defined || name == 0 || name >= strtab_size)
+                continue;
+
+            // $a, $t and $d only mark where ARM, THUMB and data start
+            if ((type != ELF_STT_FUNC && type != ELF_STT_NOTYPE) || strtab[name] == '$')
+                continue;
+
+            // THUMB functions have bit 0 set
+            uint32_t addr = read_le32(symbol + 4) & ~1u;
+            if (add_symbol(profiler, &capacity, addr, read_le32(symbol + 8), strtab + name))
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Add the symbols in a GNU ld map file, which are on lines of just an
+ * address and a name. Returns -1 if out of memory.
+ */
+static int load_map_symbols(gba_profiler *profiler, char *map)
+{
+    size_t capacity = 0;
+
+    for (char *line = strtok(map, "\n"); line != NULL; line = strtok(NULL, "\n"))
+    {
+        unsigned long addr;
+        char name[256];
+        int end = 0;
+
+        if (sscanf(line, " 0x%lx %255s %n", &addr, name, &end) != 2 || line[end] != '\0')
+            continue;
+
+        if (!isalpha((unsigned char)name[0]) && name[0] != '_')
+            continue;
+
+        if (add_symbol(profiler, &capacity, addr & ~1ul, 0, name))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const profile_symbol *sa = a;
+    const profile_symbol *sb = b;
+    return (sa->addr > sb->addr) - (sa->addr < sb->addr);
+}
+
+int load_profile_symbols(gba_profiler *profiler, const char *symbolfile)
+{
+    FILE *f = fopen(symbolfile, "rb");
+    if (f == NULL)
+        goto open_error;
+
+    if (fseek(f, 0, SEEK_END))
+        goto read_error;
+
+    long size = ftell(f);
+    if (size < 0 || fseek(f, 0, SEEK_SET))
+        goto read_error;
+
+    // NUL terminated for parsing map files
+    uint8_t *contents = malloc(size + 1);
+    if (contents == NULL)
+        goto read_error;
+
+    if (fread(contents, 1, size, f) != (size_t)size)
+    {
+        free(contents);
+        goto read_error;
+    }
+
+    fclose(f);
+    contents[size] = '\0';
+
+    free_symbols(profiler);
+
+    int result;
+    if (size >= 4 && memcmp(contents, "\x7f" "ELF", 4) == 0)
+        result = load_elf_symbols(profiler, contents, size);
+    else
+        result = load_map_symbols(profiler, (char *)contents);
+
+    free(contents);
+
+    if (result)
+    {
+        fprintf(stderr, "Failed to load symbols from %s\n", symbolfile);
+        free_symbols(profiler);
+        return -1;
+    }
+
+    qsort(profiler->symbols, profiler->num_symbols, sizeof(profile_symbol), compare_symbols);
+    return 0;
+
+read_error:
+    fclose(f);
+open_error:
+    perror("Error reading symbols");
+    return -1;
+}
+
+/* The symbol an address is in, or NULL. A symbol of unknown size runs up
+ * to the next one, as long as it's in the same region of memory.
+ */
+static const profile_symbol *find_symbol(const gba_profiler *profiler, uint32_t addr)
+{
+    // last symbol at or before addr
+    size_t lo = 0, hi = profiler->num_symbols;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (profiler->symbols[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return NULL;
+
+    const profile_symbol *symbol = &profiler->symbols[lo - 1];
+    if (symbol->size ? addr - symbol->addr >= symbol->size : addr >> 24 != symbol->addr >> 24)
+        return NULL;
+
+    return symbol;
+}
+
+static const char *region_name(uint32_t addr)
+{
+    switch (addr >> 24)
+    {
+        case 0x00: return "bios";
+        case 0x02: return "ewram";
+        case 0x03: return "iwram";
+        case 0x08: case 0x09:
+        case 0x0a: case 0x0b:
+        case 0x0c: case 0x0d: return "rom";
+        default: return "other";
+    }
+}
+
+/* A sampled address, with what it's attributed to */
+typedef struct profile_entry {
+    uint32_t addr;
+    const profile_symbol *symbol;
+    uint64_t count;
+} profile_entry;
+
+/* Order entries so that the ones in the same function are together */
+static int compare_entries(const void *a, const void *b)
+{
+    const profile_entry *ea = a;
+    const profile_entry *eb = b;
+    uint32_t ka = ea->symbol != NULL ? ea->symbol->addr : ea->addr;
+    uint32_t kb = eb->symbol != NULL ? eb->symbol->addr : eb->addr;
+    if (ka != kb)
+        return (ka > kb) - (ka < kb);
+
+    return (ea->symbol == NULL) - (eb->symbol == NULL);
+}
+
+static bool same_function(const profile_entry *a, const profile_entry *b)
+{
+    if (a->symbol != NULL || b->symbol != NULL)
+        return a->symbol == b->symbol;
+
+    return a->addr == b->addr;
+}
+
+int write_profile(const gba_profiler *profiler, const char *profilefile)
+{
+    profile_entry *entries = malloc((profiler->num_used + 1) * sizeof(profile_entry));
+    if (entries == NULL)
+    {
+        fputs("Failed to allocate profile\n", stderr);
+        return -1;
+    }
+
+    size_t num_entries = 0;
+    for (size_t i = 0; i < profiler->num_slots; ++i)
+    {
+        const pc_sample *sample = &profiler->samples[i];
+        if (sample->key == 0)
+            continue;
+
+        uint32_t addr = sample->key & ~1u;
+        entries[num_entries++] = (profile_entry){addr, find_symbol(profiler, addr), sample->count};
+    }
+
+    qsort(entries, num_entries, sizeof(profile_entry), compare_entries);
+
+    FILE *f = fopen(profilefile, "w");
+    if (f == NULL)
+    {
+        perror("Error writing profile");
+        free(entries);
+        return -1;
+    }
+
+    // one line per function, adding up the addresses sampled in it
+    for (size_t i = 0; i < num_entries;)
+    {
+        uint64_t count = 0;
+        size_t first = i;
+        for (; i < num_entries && same_function(&entries[first], &entries[i]); ++i)
+            count += entries[i].count;
+
+        const profile_entry *entry = &entries[first];
+        fprintf(f, "%s;", region_name(entry->addr));
+        if (entry->symbol != NULL)
+            fputs(entry->symbol->name, f);
+        else
+            fprintf(f, "0x%08x", entry->addr);
+        fprintf(f, " %llu\n", (unsigned long long)count);
+    }
+
+    free(entries);
+
+    if (fclose(f))
+    {
+        perror("Error writing profile");
+        return -1;
+    }
+
+    printf("Wrote %llu samples of the PC to %s\n",
+           (unsigned long long)profiler->total_samples,
+           profilefile);
+    return 0;
+}
@@ -0,0 +1,413 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/error.h"
+#include "cgba/gba.h"
+#include "cgba/rewind.h"
+#include "cgba/savestate.h"
+
+/* Runs of unchanged bytes shorter than this are kept in the literal
+ * around them, since a new run costs more to encode than it saves
+ */
+#define MIN_ZERO_RUN 8
+
+/* Most snapshots that fit in the ring if they barely changed */
+#define MAX_ENTRIES 16384
+
+/* A delta in the ring, which turns the snapshot after it into this one */
+typedef struct rewind_entry {
+    size_t offset;
+    size_t size;
+} rewind_entry;
+
+struct rewind_buffer {
+    size_t state_size;
+    int interval;
+    int frames_until_snapshot;
+
+    // deltas from oldest to newest, laid out one after another
+    // in the ring, wrapping back to the start when out of room
+    uint8_t *ring;
+    size_t ring_size;
+    size_t ring_head;
+    rewind_entry entries[MAX_ENTRIES];
+    size_t first_entry;
+    size_t num_entries;
+
+    // owned by the encoding thread while busy
+    uint8_t *newest;       // newest snapshot, which the deltas lead back from
+    bool has_newest;
+    bool newest_loaded;    // the system was last rewound to the newest snapshot
+    uint8_t *incoming;     // snapshot waiting to be encoded
+    uint8_t *encoded;      // delta being encoded
+    size_t encoded_capacity;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    bool busy;
+    bool quit;
+};
+
+static uint8_t *write_varint(uint8_t *out, size_t n)
+{
+    while (n >= 0x80)
+    {
+        *out++ = n | 0x80;
+        n >>= 7;
+    }
+
+    *out++ = n;
+    return out;
+}
+
+static const uint8_t *read_varint(const uint8_t *in, size_t *n)
+{
+    size_t value = 0;
+    int shift = 0;
+
+    for (; *in & 0x80; shift += 7)
+        value |= (size_t)(*in++ & 0x7f) << shift;
+
+    *n = value | (size_t)*in++ << shift;
+    return in;
+}
+
+static size_t skip_equal_bytes(const uint8_t *a, const uint8_t *b, size_t i, size_t size)
+{
+    // a word at a time while they match, since most of the state doesn't change
+    while (i + 8 <= size)
+    {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y)
+            break;
+
+        i += 8;
+    }
+
+    while (i < size && a[i] == b[i])
+        ++i;
+
+    return i;
+}
+
+/* Encode a ^ b as a series of runs: the number of zero bytes, the
+ * number of literal bytes, and the literal bytes. Returns the size.
+ */
+static size_t encode_delta(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out)
+{
+    uint8_t *start = out;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        size_t zeros_start = i;
+        i = skip_equal_bytes(a, b, i, size);
+
+        size_t literal_start = i;
+        while (i < size)
+        {
+            if (a[i] != b[i])
+            {
+                ++i;
+                continue;
+            }
+
+            size_t run_end = i;
+            while (run_end < size && a[run_end] == b[run_end] && run_end - i < MIN_ZERO_RUN)
+                ++run_end;
+
+            if (run_end - i >= MIN_ZERO_RUN || run_end == size)
+                break;
+
+            i = run_end;
+        }
+
+        out = write_varint(out, literal_start - zeros_start);
+        out = write_varint(out, i - literal_start);
+        for (size_t j = literal_start; j < i; ++j)
+            *out++ = a[j] ^ b[j];
+    }
+
+    return out - start;
+}
+
+/* XOR an encoded delta into state. Zero runs are left alone. */
+static void apply_delta(uint8_t *state, const uint8_t *delta, size_t delta_size)
+{
+    const uint8_t *end = delta + delta_size;
+    size_t i = 0;
+
+    while (delta < end)
+    {
+        size_t zeros, literals;
+        delta = read_varint(delta, &zeros);
+        delta = read_varint(delta, &literals);
+
+        i += zeros;
+        for (size_t j = 0; j < literals; ++j)
+            state[i + j] ^= delta[j];
+
+        i += literals;
+        delta += literals;
+    }
+}
+
+static rewind_entry *oldest_entry(rewind_buffer *rw)
+{
+    return &rw->entries[rw->first_entry];
+}
+
+static rewind_entry *newest_entry(rewind_buffer *rw)
+{
+    return &rw->entries[(rw->first_entry + rw->num_entries - 1) % MAX_ENTRIES];
+}
+
+static void drop_oldest_entry(rewind_buffer *rw)
+{
+    rw->first_entry = (rw->first_entry + 1) % MAX_ENTRIES;
+    --rw->num_entries;
+}
+
+#ifdef DEBUG
+/* Check that the live deltas run from oldest to newest around the ring,
+ * wrapping at most once and never reaching back into the oldest
+ */
+static void check_ring(rewind_buffer *rw)
+{
+    bool wrapped = false;
+    size_t prev_end = 0;
+
+    for (size_t i = 0; i < rw->num_entries; ++i)
+    {
+        const rewind_entry *entry = &rw->entries[(rw->first_entry + i) % MAX_ENTRIES];
+
+        if (i > 0 && entry->offset < prev_end)
+        {
+            if (wrapped)
+                fatal_error("Rewind ring wrapped twice at entry %zu\n", i);
+
+            wrapped = true;
+        }
+
+        if (wrapped && entry->offset + entry->size > oldest_entry(rw)->offset)
+            fatal_error("Rewind entry %zu overwrites the oldest entry\n", i);
+
+        prev_end = entry->offset + entry->size;
+    }
+}
+#endif
+
+/* Put the encoded delta into the ring, dropping the oldest
+ * deltas where it's going to go
+ */
+static void store_delta(rewind_buffer *rw, size_t size)
+{
+    // nothing older than this can be reached without it
+    if (size > rw->ring_size)
+    {
+        rw->num_entries = 0;
+        rw->ring_head = 0;
+        return;
+    }
+
+    size_t offset = rw->ring_head;
+    if (offset + size > rw->ring_size)
+    {
+        // The deltas left past the head from the last pass round are
+        // the oldest, and are given up along with the space they're in.
+        // Dropping them first lets the overlap check below start from
+        // the ones at the start of the ring, which are next in line.
+        while (rw->num_entries && oldest_entry(rw)->offset >= rw->ring_head)
+            drop_oldest_entry(rw);
+
+        offset = 0;
+    }
+
+    // deltas overlapping the space are the oldest ones
+    while (rw->num_entries)
+    {
+        rewind_entry *oldest = oldest_entry(rw);
+        bool overlaps = oldest->offset < offset + size && offset < oldest->offset + oldest->size;
+        if (!overlaps && rw->num_entries < MAX_ENTRIES)
+            break;
+
+        drop_oldest_entry(rw);
+    }
+
+    memcpy(rw->ring + offset, rw->encoded, size);
+    rw->ring_head = offset + size;
+
+    ++rw->num_entries;
+    *newest_entry(rw) = (rewind_entry){offset, size};
+
+#ifdef DEBUG
+    check_ring(rw);
+#endif
+}
+
+static void encode_snapshot(rewind_buffer *rw)
+{
+    if (rw->has_newest)
+    {
+        size_t size = encode_delta(rw->newest, rw->incoming, rw->state_size, rw->encoded);
+        store_delta(rw, size);
+    }
+
+    uint8_t *newest = rw->newest;
+    rw->newest = rw->incoming;
+    rw->incoming = newest;
+    rw->has_newest = true;
+    rw->newest_loaded = false;
+}
+
+static void *encoder_main(void *arg)
+{
+    rewind_buffer *rw = arg;
+
+    pthread_mutex_lock(&rw->lock);
+    while (true)
+    {
+        while (!rw->busy && !rw->quit)
+            pthread_cond_wait(&rw->work_ready, &rw->lock);
+
+        if (rw->quit)
+            break;
+
+        pthread_mutex_unlock(&rw->lock);
+        encode_snapshot(rw);
+        pthread_mutex_lock(&rw->lock);
+
+        rw->busy = false;
+        pthread_cond_signal(&rw->work_done);
+    }
+    pthread_mutex_unlock(&rw->lock);
+
+    return NULL;
+}
+
+rewind_buffer *create_rewind_buffer(int interval, size_t buffer_size)
+{
+    rewind_buffer *rw = malloc(sizeof(rewind_buffer));
+    if (rw == NULL)
+        return NULL;
+
+    memset(rw, 0, sizeof(rewind_buffer));
+    rw->state_size = savestate_size();
+    rw->interval = interval;
+    rw->frames_until_snapshot = interval;
+    rw->ring_size = buffer_size;
+
+    // at worst every run is one literal byte between short zero runs
+    rw->encoded_capacity = 2 * rw->state_size + 16;
+
+    rw->ring = malloc(buffer_size);
+    rw->newest = malloc(rw->state_size);
+    rw->incoming = malloc(rw->state_size);
+    rw->encoded = malloc(rw->encoded_capacity);
+    if (!rw->ring || !rw->newest || !rw->incoming || !rw->encoded)
+        goto alloc_error;
+
+    if (pthread_mutex_init(&rw->lock, NULL))
+        goto alloc_error;
+
+    if (pthread_cond_init(&rw->work_ready, NULL))
+        goto work_ready_error;
+
+    if (pthread_cond_init(&rw->work_done, NULL))
+        goto work_done_error;
+
+    if (pthread_create(&rw->thread, NULL, encoder_main, rw))
+        goto thread_error;
+
+    return rw;
+
+thread_error:
+    pthread_cond_destroy(&rw->work_done);
+work_done_error:
+    pthread_cond_destroy(&rw->work_ready);
+work_ready_error:
+    pthread_mutex_destroy(&rw->lock);
+alloc_error:
+    free(rw->ring);
+    free(rw->newest);
+    free(rw->incoming);
+    free(rw->encoded);
+    free(rw);
+    return NULL;
+}
+
+void destroy_rewind_buffer(rewind_buffer *rw)
+{
+    if (rw == NULL)
+        return;
+
+    pthread_mutex_lock(&rw->lock);
+    rw->quit = true;
+    pthread_cond_signal(&rw->work_ready);
+    pthread_mutex_unlock(&rw->lock);
+    pthread_join(rw->thread, NULL);
+
+    pthread_cond_destroy(&rw->work_done);
+    pthread_cond_destroy(&rw->work_ready);
+    pthread_mutex_destroy(&rw->lock);
+    free(rw->ring);
+    free(rw->newest);
+    free(rw->incoming);
+    free(rw->encoded);
+    free(rw);
+}
+
+void record_rewind_frame(rewind_buffer *rw, gba_system *gba)
+{
+    if (--rw->frames_until_snapshot > 0)
+        return;
+
+    pthread_mutex_lock(&rw->lock);
+    bool busy = rw->busy;
+    pthread_mutex_unlock(&rw->lock);
+
+    if (busy)
+        return;
+
+    save_state(gba, rw->incoming);
+    rw->frames_until_snapshot = rw->interval;
+
+    pthread_mutex_lock(&rw->lock);
+    rw->busy = true;
+    pthread_cond_signal(&rw->work_ready);
+    pthread_mutex_unlock(&rw->lock);
+}
+
+int rewind_step_back(rewind_buffer *rw, gba_system *gba)
+{
+    pthread_mutex_lock(&rw->lock);
+    while (rw->busy)
+        pthread_cond_wait(&rw->work_done, &rw->lock);
+    pthread_mutex_unlock(&rw->lock);
+
+    if (!rw->has_newest)
+        return -1;
+
+    // decode one snapshot further back, dropping the newest
+    if (rw->newest_loaded && rw->num_entries)
+    {
+        rewind_entry *entry = newest_entry(rw);
+        apply_delta(rw->newest, rw->ring + entry->offset, entry->size);
+        rw->ring_head = entry->offset;
+        --rw->num_entries;
+    }
+
+    if (load_state(gba, rw->newest, rw->state_size))
+        return -1;
+
+    rw->newest_loaded = true;
+    rw->frames_until_snapshot = rw->interval;
+    return 0;
+}
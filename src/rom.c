@@ -0,0 +1,110 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgba/rom.h"
+
+struct gba_rom {
+    atomic_int refcount;
+
+    // allocated zeroed, so the part past the end of
+    // the game costs nothing until it's read
+    uint8_t *data;
+    size_t size; // of the game itself
+};
+
+static gba_rom *alloc_rom_image(void)
+{
+    gba_rom *rom = malloc(sizeof(gba_rom));
+    if (rom == NULL)
+        return NULL;
+
+    rom->data = calloc(1, GBA_ROM_SIZE);
+    if (rom->data == NULL)
+    {
+        free(rom);
+        return NULL;
+    }
+
+    atomic_init(&rom->refcount, 1);
+    rom->size = 0;
+    return rom;
+}
+
+gba_rom *load_rom_image(const char *romfile)
+{
+    FILE *fptr = fopen(romfile, "rb");
+    if (fptr == NULL)
+        goto open_error;
+
+    gba_rom *rom = alloc_rom_image();
+    if (rom == NULL)
+        goto alloc_error;
+
+    size_t bytes_read = fread(rom->data, 1, GBA_ROM_SIZE, fptr);
+
+    if (bytes_read != GBA_ROM_SIZE && ferror(fptr))
+        goto load_error;
+
+    // anything left over wouldn't be addressable, rather than cut it off
+    if (bytes_read == GBA_ROM_SIZE && fgetc(fptr) != EOF)
+        goto size_error;
+
+    rom->size = bytes_read;
+    fclose(fptr);
+    return rom;
+
+size_error:
+    fputs("Error loading ROM: larger than the 32 MiB ROM address space\n", stderr);
+    release_rom_image(rom);
+    fclose(fptr);
+    return NULL;
+
+load_error:
+    release_rom_image(rom);
+alloc_error:
+    fclose(fptr);
+open_error:
+    perror("Error loading ROM");
+    return NULL;
+}
+
+gba_rom *create_rom_image(const void *data, size_t size)
+{
+    if (size > GBA_ROM_SIZE)
+        return NULL;
+
+    gba_rom *rom = alloc_rom_image();
+    if (rom == NULL)
+        return NULL;
+
+    memcpy(rom->data, data, size);
+    rom->size = size;
+    return rom;
+}
+
+gba_rom *retain_rom_image(gba_rom *rom)
+{
+    atomic_fetch_add_explicit(&rom->refcount, 1, memory_order_relaxed);
+    return rom;
+}
+
+void release_rom_image(gba_rom *rom)
+{
+    if (atomic_fetch_sub_explicit(&rom->refcount, 1, memory_order_acq_rel) > 1)
+        return;
+
+    free(rom->data);
+    free(rom);
+}
+
+const uint8_t *rom_image_data(const gba_rom *rom)
+{
+    return rom->data;
+}
+
+size_t rom_image_size(const gba_rom *rom)
+{
+    return rom->size;
+}
@@ -0,0 +1,215 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cgba/cgba.h"
+
+/* Each batch of instances is dealt out evenly, one queue per thread.
+ * A thread works through its own queue and then steals what's left of
+ * the others', so instances that take longer to step don't leave the
+ * rest of the pool idle.
+ */
+typedef struct runner_queue {
+    alignas(64) atomic_size_t next; // shared with thieves
+    size_t end;
+} runner_queue;
+
+typedef struct runner_worker {
+    cgba_runner *runner;
+    int queueno;
+} runner_worker;
+
+struct cgba_runner {
+    int num_threads;
+    pthread_t *threads;
+    runner_worker *workers;
+    runner_queue *queues;
+
+    // the batch being stepped
+    cgba **gbas;
+    const uint16_t *buttons_held;
+    const uint32_t **frames;
+    cgba_status *statuses;
+
+    pthread_mutex_t lock;
+    pthread_cond_t batch_ready;
+    pthread_cond_t batch_done;
+    unsigned batchno;
+    int workers_busy;
+    bool quit;
+};
+
+static void run_tasks(cgba_runner *runner, int queueno)
+{
+    for (int i = 0; i < runner->num_threads; ++i)
+    {
+        runner_queue *queue = &runner->queues[(queueno + i) % runner->num_threads];
+
+        size_t task;
+        while ((task = atomic_fetch_add(&queue->next, 1)) < queue->end)
+        {
+            runner->statuses[task] = cgba_step_frame(runner->gbas[task],
+                                                     runner->buttons_held[task],
+                                                     &runner->frames[task]);
+        }
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    runner_worker *worker = arg;
+    cgba_runner *runner = worker->runner;
+    unsigned batchno = 0;
+
+    pthread_mutex_lock(&runner->lock);
+    while (true)
+    {
+        while (runner->batchno == batchno && !runner->quit)
+            pthread_cond_wait(&runner->batch_ready, &runner->lock);
+
+        if (runner->quit)
+            break;
+
+        batchno = runner->batchno;
+        pthread_mutex_unlock(&runner->lock);
+
+        run_tasks(runner, worker->queueno);
+
+        pthread_mutex_lock(&runner->lock);
+        if (--runner->workers_busy == 0)
+            pthread_cond_signal(&runner->batch_done);
+    }
+    pthread_mutex_unlock(&runner->lock);
+
+    return NULL;
+}
+
+static void stop_workers(cgba_runner *runner, int num_started)
+{
+    pthread_mutex_lock(&runner->lock);
+    runner->quit = true;
+    pthread_cond_broadcast(&runner->batch_ready);
+    pthread_mutex_unlock(&runner->lock);
+
+    for (int i = 0; i < num_started; ++i)
+        pthread_join(runner->threads[i], NULL);
+}
+
+cgba_runner *cgba_runner_create(int num_threads)
+{
+    if (num_threads <= 0)
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (num_threads <= 0)
+        num_threads = 1;
+
+    cgba_runner *runner = malloc(sizeof(cgba_runner));
+    if (runner == NULL)
+        return NULL;
+
+    memset(runner, 0, sizeof(cgba_runner));
+    runner->num_threads = num_threads;
+
+    // the calling thread takes the first queue
+    runner->threads = malloc(sizeof(pthread_t) * num_threads);
+    runner->workers = malloc(sizeof(runner_worker) * num_threads);
+    runner->queues = aligned_alloc(alignof(runner_queue), sizeof(runner_queue) * num_threads);
+    if (runner->threads == NULL || runner->workers == NULL || runner->queues == NULL)
+        goto alloc_error;
+
+    for (int i = 0; i < num_threads; ++i)
+    {
+        atomic_init(&runner->queues[i].next, 0);
+        runner->queues[i].end = 0;
+    }
+
+    if (pthread_mutex_init(&runner->lock, NULL))
+        goto alloc_error;
+
+    if (pthread_cond_init(&runner->batch_ready, NULL))
+        goto batch_ready_error;
+
+    if (pthread_cond_init(&runner->batch_done, NULL))
+        goto batch_done_error;
+
+    int num_started;
+    for (num_started = 0; num_started < num_threads - 1; ++num_started)
+    {
+        runner_worker *worker = &runner->workers[num_started];
+        worker->runner = runner;
+        worker->queueno = num_started + 1;
+
+        if (pthread_create(&runner->threads[num_started], NULL, worker_main, worker))
+            goto thread_error;
+    }
+
+    return runner;
+
+thread_error:
+    stop_workers(runner, num_started);
+    pthread_cond_destroy(&runner->batch_done);
+batch_done_error:
+    pthread_cond_destroy(&runner->batch_ready);
+batch_ready_error:
+    pthread_mutex_destroy(&runner->lock);
+alloc_error:
+    free(runner->threads);
+    free(runner->workers);
+    free(runner->queues);
+    free(runner);
+    return NULL;
+}
+
+void cgba_runner_destroy(cgba_runner *runner)
+{
+    if (runner == NULL)
+        return;
+
+    stop_workers(runner, runner->num_threads - 1);
+    pthread_cond_destroy(&runner->batch_done);
+    pthread_cond_destroy(&runner->batch_ready);
+    pthread_mutex_destroy(&runner->lock);
+    free(runner->threads);
+    free(runner->workers);
+    free(runner->queues);
+    free(runner);
+}
+
+void cgba_runner_step(cgba_runner *runner,
+                      cgba **gbas,
+                      const uint16_t *buttons_held,
+                      const uint32_t **frames,
+                      cgba_status *statuses,
+                      size_t count)
+{
+    int num_threads = runner->num_threads;
+
+    runner->gbas = gbas;
+    runner->buttons_held = buttons_held;
+    runner->frames = frames;
+    runner->statuses = statuses;
+
+    for (int i = 0; i < num_threads; ++i)
+    {
+        atomic_store(&runner->queues[i].next, count * i / num_threads);
+        runner->queues[i].end = count * (i + 1) / num_threads;
+    }
+
+    pthread_mutex_lock(&runner->lock);
+    ++runner->batchno;
+    runner->workers_busy = num_threads - 1;
+    pthread_cond_broadcast(&runner->batch_ready);
+    pthread_mutex_unlock(&runner->lock);
+
+    run_tasks(runner, 0);
+
+    pthread_mutex_lock(&runner->lock);
+    while (runner->workers_busy)
+        pthread_cond_wait(&runner->batch_done, &runner->lock);
+    pthread_mutex_unlock(&runner->lock);
+}
@@ -0,0 +1,106 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "cgba/cpu.h"
+#include "cgba/gamepad.h"
+#include "cgba/gba.h"
+#include "cgba/memory.h"
+#include "cgba/ppu.h"
+#include "cgba/savestate.h"
+
+#define SAVESTATE_MAGIC "CGBS"
+
+/* The saved part of each component is a prefix of its struct */
+#define CPU_STATE_SIZE offsetof(arm7tdmi, mem)
+#define MEM_STATE_SIZE offsetof(gba_mem, bios)
+#define PPU_STATE_SIZE offsetof(gba_ppu, mem)
+
+typedef struct savestate_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t size; // of the whole save state, header included
+    uint32_t gamepad_state;
+    uint64_t layout; // layout_fingerprint() of the build that saved it
+    uint64_t clocks_emulated;
+} savestate_header;
+
+/* Sections follow the header in this order */
+#define CPU_STATE_OFFSET sizeof(savestate_header)
+#define MEM_STATE_OFFSET (CPU_STATE_OFFSET + CPU_STATE_SIZE)
+#define PPU_STATE_OFFSET (MEM_STATE_OFFSET + MEM_STATE_SIZE)
+#define SAVESTATE_SIZE   (PPU_STATE_OFFSET + PPU_STATE_SIZE)
+
+/* The sections are raw struct prefixes, so adding, removing or resizing
+ * a field changes what another build's save state means. Fingerprinting
+ * the sizes of the structs and of their saved prefixes turns most such
+ * save states away, even if nobody remembered to bump the version.
+ */
+static uint64_t layout_fingerprint(void)
+{
+    const uint64_t sizes[] = {
+        CPU_STATE_SIZE, sizeof(arm7tdmi),
+        MEM_STATE_SIZE, sizeof(gba_mem),
+        PPU_STATE_SIZE, sizeof(gba_ppu),
+    };
+
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; ++i)
+        hash = (hash ^ sizes[i]) * 0x100000001b3;
+
+    return hash;
+}
+
+size_t savestate_size(void)
+{
+    return SAVESTATE_SIZE;
+}
+
+void save_state(const gba_system *gba, void *buf)
+{
+    uint8_t *state = buf;
+
+    savestate_header header = {
+        .magic = SAVESTATE_MAGIC,
+        .version = SAVESTATE_VERSION,
+        .size = SAVESTATE_SIZE,
+        .gamepad_state = gba->gamepad->state,
+        .layout = layout_fingerprint(),
+        .clocks_emulated = gba->clocks_emulated,
+    };
+
+    memcpy(state, &header, sizeof header);
+    memcpy(state + CPU_STATE_OFFSET, gba->cpu, CPU_STATE_SIZE);
+    memcpy(state + MEM_STATE_OFFSET, gba->mem, MEM_STATE_SIZE);
+    memcpy(state + PPU_STATE_OFFSET, gba->ppu, PPU_STATE_SIZE);
+}
+
+int load_state(gba_system *gba, const void *buf, size_t size)
+{
+    const uint8_t *state = buf;
+
+    savestate_header header;
+    if (size < SAVESTATE_SIZE)
+        return -1;
+
+    memcpy(&header, state, sizeof header);
+    if (memcmp(header.magic, SAVESTATE_MAGIC, sizeof header.magic)
+        || header.version != SAVESTATE_VERSION
+        || header.size != SAVESTATE_SIZE
+        || header.layout != layout_fingerprint())
+    {
+        return -1;
+    }
+
+    memcpy(gba->cpu, state + CPU_STATE_OFFSET, CPU_STATE_SIZE);
+    memcpy(gba->mem, state + MEM_STATE_OFFSET, MEM_STATE_SIZE);
+    memcpy(gba->ppu, state + PPU_STATE_OFFSET, PPU_STATE_SIZE);
+    gba->gamepad->state = header.gamepad_state;
+    gba->clocks_emulated = header.clocks_emulated;
+
+    // the renderer's copies and caches of display memory are all stale
+    mark_display_memory_dirty(gba->ppu);
+    gba->ppu->frame_presented_signal = false;
+
+    return 0;
+}
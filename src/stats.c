@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "cgba/stats.h"
+
+// defined even when not counting, so the writers always have something to write
+_Thread_local emulation_stats thread_stats;
+
+static const char *counter_names[NUM_STAT_COUNTERS] = {
+    [STAT_ARM_BX]                         = "arm.bx",
+    [STAT_ARM_BRANCH]                     = "arm.branch",
+    [STAT_ARM_PROCESS_DATA]               = "arm.process_data",
+    [STAT_ARM_BLOCK_DATA_TRANSFER]        = "arm.block_data_transfer",
+    [STAT_ARM_SINGLE_DATA_TRANSFER]       = "arm.single_data_transfer",
+    [STAT_ARM_HALFWORD_TRANSFER]          = "arm.halfword_transfer",
+    [STAT_ARM_MRS_TRANSFER]               = "arm.mrs_transfer",
+    [STAT_ARM_MSR_TRANSFER]               = "arm.msr_transfer",
+    [STAT_ARM_MULTIPLY]                   = "arm.multiply",
+    [STAT_ARM_SINGLE_DATA_SWAP]           = "arm.single_data_swap",
+    [STAT_ARM_UNDEFINED]                  = "arm.undefined",
+    [STAT_THUMB_UNCONDITIONAL_BRANCH]     = "thumb.unconditional_branch",
+    [STAT_THUMB_CONDITIONAL_BRANCH]       = "thumb.conditional_branch",
+    [STAT_THUMB_MULTIPLE_LOAD_STORE]      = "thumb.multiple_load_store",
+    [STAT_THUMB_LONG_BRANCH_WITH_LINK]    = "thumb.long_branch_with_link",
+    [STAT_THUMB_ADD_OFFSET_TO_SP]         = "thumb.add_offset_to_sp",
+    [STAT_THUMB_OPERATE_WITH_IMMEDIATE]   = "thumb.operate_with_immediate",
+    [STAT_THUMB_HI_REGISTER_OP_OR_BX]     = "thumb.hi_register_op_or_bx",
+    [STAT_THUMB_PUSH_POP_REGISTERS]       = "thumb.push_pop_registers",
+    [STAT_THUMB_LOAD_STORE_HALFWORD]      = "thumb.load_store_halfword",
+    [STAT_THUMB_SP_RELATIVE_LOAD_STORE]   = "thumb.sp_relative_load_store",
+    [STAT_THUMB_LOAD_ADDRESS]             = "thumb.load_address",
+    [STAT_THUMB_LOAD_STORE_WITH_OFFSET]   = "thumb.load_store_with_offset",
+    [STAT_THUMB_LOAD_STORE_SIGN_EXTENDED] = "thumb.load_store_sign_extended",
+    [STAT_THUMB_PC_RELATIVE_LOAD]         = "thumb.pc_relative_load",
+    [STAT_THUMB_ALU_OPERATION]            = "thumb.alu_operation",
+    [STAT_THUMB_ADD_SUBTRACT]             = "thumb.add_subtract",
+    [STAT_THUMB_MOVE_SHIFTED_REGISTER]    = "thumb.move_shifted_register",
+    [STAT_SOFTWARE_INTERRUPT]             = "software_interrupt",
+    [STAT_COND_PASSED]                    = "cond.passed",
+    [STAT_COND_FAILED]                    = "cond.failed",
+    [STAT_PIPELINE_RELOADS]               = "pipeline_reloads",
+    [STAT_IRQ_ENTRIES]                    = "irq_entries",
+};
+
+static const char *access_names[NUM_STAT_ACCESSES] = {"read", "write"};
+
+static const char *width_names[NUM_STAT_WIDTHS] = {"byte", "halfword", "word"};
+
+static const char *region_names[NUM_STAT_REGIONS] = {
+    [STAT_REGION_BIOS]     = "bios",
+    [STAT_REGION_EWRAM]    = "ewram",
+    [STAT_REGION_IWRAM]    = "iwram",
+    [STAT_REGION_IO]       = "io",
+    [STAT_REGION_PALETTE]  = "palette",
+    [STAT_REGION_VRAM]     = "vram",
+    [STAT_REGION_OAM]      = "oam",
+    [STAT_REGION_ROM]      = "rom",
+    [STAT_REGION_SRAM]     = "sram",
+    [STAT_REGION_UNMAPPED] = "unmapped",
+};
+
+/* Call write_count with the name and count of every counter, in order.
+ * Memory accesses are named mem.<access>.<width>.<region>.
+ */
+static void for_each_count(FILE *f, void (*write_count)(FILE *, const char *, uint64_t, bool))
+{
+    char name[64];
+    bool first = true;
+
+    for (int i = 0; i < NUM_STAT_COUNTERS; ++i)
+    {
+        write_count(f, counter_names[i], thread_stats.counters[i], first);
+        first = false;
+    }
+
+    for (int access = 0; access < NUM_STAT_ACCESSES; ++access)
+    {
+        for (int width = 0; width < NUM_STAT_WIDTHS; ++width)
+        {
+            for (int region = 0; region < NUM_STAT_REGIONS; ++region)
+            {
+                snprintf(name, sizeof name, "mem.%s.%s.%s",
+                         access_names[access],
+                         width_names[width],
+                         region_names[region]);
+                write_count(f, name, thread_stats.mem_accesses[access][width][region], false);
+            }
+        }
+    }
+}
+
+static void write_csv_count(FILE *f, const char *name, uint64_t count, bool first)
+{
+    (void)first;
+    fprintf(f, "%s,%llu\n", name, (unsigned long long)count);
+}
+
+static void write_json_count(FILE *f, const char *name, uint64_t count, bool first)
+{
+    fprintf(f, "%s\n  \"%s\": %llu", first ? "" : ",", name, (unsigned long long)count);
+}
+
+void write_stats_csv(FILE *f)
+{
+    fputs("counter,count\n", f);
+    for_each_count(f, write_csv_count);
+}
+
+void write_stats_json(FILE *f)
+{
+    fputc('{', f);
+    for_each_count(f, write_json_count);
+    fputs("\n}\n", f);
+}
+
+int dump_stats(const char *statsfile)
+{
+    FILE *f = fopen(statsfile, "w");
+    if (f == NULL)
+    {
+        perror("Error writing stats");
+        return -1;
+    }
+
+    size_t len = strlen(statsfile);
+    if (len >= 5 && strcmp(statsfile + len - 5, ".json") == 0)
+        write_stats_json(f);
+    else
+        write_stats_csv(f);
+
+    if (fclose(f))
+    {
+        perror("Error writing stats");
+        return -1;
+    }
+
+    return 0;
+}
+
+void reset_stats(void)
+{
+    memset(&thread_stats, 0, sizeof thread_stats);
+}
+
+void save_stats(emulation_stats *stats)
+{
+    *stats = thread_stats;
+}
+
+void restore_stats(const emulation_stats *stats)
+{
+    thread_stats = *stats;
+}